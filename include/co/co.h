@@ -7,10 +7,14 @@
 #include "./co/sock.h"
 #include "./co/event.h"
 #include "./co/mutex.h"
+#include "./co/rwmutex.h"
+#include "./co/semaphore.h"
+#include "./co/cond_var.h"
 #include "./co/pool.h"
 #include "./co/chan.h"
 #include "./co/io_event.h"
 #include "./co/wait_group.h"
+#include "./co/future.h"
 #include <vector>
 
 namespace co {
@@ -304,3 +308,7 @@ __codec void stop();
 } // namespace co
 
 using co::go;
+
+// TaskGroup starts coroutines with go(), it is included after the declarations
+// above.
+#include "./co/task_group.h"
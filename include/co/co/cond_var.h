@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../def.h"
+#include "../atomic.h"
+#include "mutex.h"
+
+namespace co {
+
+/**
+ * co::CondVar is a condition variable for coroutines
+ *   - It works with co::Mutex, like std::condition_variable with std::mutex.
+ *   - wait() MUST be called in a coroutine, while notify_one() and notify_all()
+ *     can be called anywhere.
+ *   - Spurious wakeups do not happen, but the condition SHOULD still be checked
+ *     in a loop, as it may be changed by others before the mutex is acquired.
+ */
+class __codec CondVar {
+public:
+  CondVar();
+  ~CondVar();
+
+  CondVar(CondVar &&c) : _p(c._p) { c._p = 0; }
+
+  CondVar(const CondVar &c) : _p(c._p) { atomic_inc(_p); }
+
+  void operator=(const CondVar &) = delete;
+
+  /**
+   * wait for a notification
+   *   - It MUST be called in a coroutine that holds the mutex @m.
+   *   - The mutex is released while waiting, and acquired again before
+   *     it returns.
+   */
+  void wait(const co::Mutex &m) const;
+
+  /**
+   * wait for a notification with a timeout
+   *
+   * @param m   the mutex held by the calling coroutine.
+   * @param ms  timeout in milliseconds, -1 for never timeout.
+   *
+   * @return    true if notified, false on timeout.
+   */
+  bool wait(const co::Mutex &m, uint32 ms) const;
+
+  /**
+   * wake up the first waiting coroutine
+   */
+  void notify_one() const;
+
+  /**
+   * wake up all waiting coroutines
+   */
+  void notify_all() const;
+
+private:
+  uint32 *_p;
+};
+
+} // namespace co
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "../def.h"
+#include "../atomic.h"
+#include "event.h"
+#include <utility>
+
+namespace co {
+namespace xx {
+
+// state shared by co::Promise and co::Future
+template <typename T> struct FutureState {
+  enum { st_pending = 0, st_setting = 1, st_value = 2, st_error = 3 };
+
+  FutureState() : refn(1), state(st_pending), err(0), value() {}
+
+  bool begin_set() {
+    return atomic_compare_swap(&state, st_pending, st_setting) == st_pending;
+  }
+
+  void end_set(uint32 st) {
+    atomic_set(&state, st);
+    ev.signal();
+  }
+
+  // The event resets itself when a waiter takes the signal, so a waiter that
+  // was woken up signals it again for others waiting on the same future.
+  bool wait(uint32 ms) {
+    if (atomic_get(&state) >= st_value)
+      return true;
+    if (!ev.wait(ms))
+      return atomic_get(&state) >= st_value;
+    ev.signal();
+    return true;
+  }
+
+  uint32 refn;
+  uint32 state;
+  int err;
+  co::Event ev;
+  T value;
+};
+
+template <typename T> inline FutureState<T> *ref(FutureState<T> *s) {
+  if (s)
+    atomic_inc(&s->refn);
+  return s;
+}
+
+template <typename T> inline void unref(FutureState<T> *s) {
+  if (s && atomic_dec(&s->refn) == 0)
+    delete s;
+}
+
+} // namespace xx
+
+/**
+ * co::Future is the receiving side of a result produced by co::Promise
+ *   - It can be waited from anywhere, and by any number of coroutines or
+ *     threads. Waiters are woken up by the coroutine that sets the result,
+ *     no extra thread is involved.
+ *   - It is copyable, all copies refer to the same result.
+ */
+template <typename T> class Future {
+public:
+  Future() : _s(0) {}
+  ~Future() { xx::unref(_s); }
+
+  Future(Future &&f) : _s(f._s) { f._s = 0; }
+
+  Future(const Future &f) : _s(xx::ref(f._s)) {}
+
+  Future &operator=(const Future &f) {
+    if (this != &f) {
+      xx::unref(_s);
+      _s = xx::ref(f._s);
+    }
+    return *this;
+  }
+
+  // whether the future is associated with a promise
+  bool valid() const { return _s != 0; }
+
+  // whether the result, a value or an error, is ready
+  bool ready() const {
+    return atomic_get(&_s->state) >= xx::FutureState<T>::st_value;
+  }
+
+  /**
+   * wait for the result
+   *
+   * @param ms  timeout in milliseconds, -1 for never timeout.
+   *
+   * @return    true if the result is ready, false on timeout.
+   */
+  bool wait(uint32 ms = (uint32)-1) const { return _s->wait(ms); }
+
+  /**
+   * get the value
+   *   - It blocks until the result is ready.
+   *   - The value is default-constructed if an error was set.
+   */
+  T &get() const {
+    _s->wait((uint32)-1);
+    return _s->value;
+  }
+
+  /**
+   * get the error
+   *   - It blocks until the result is ready.
+   *
+   * @return  the error code set by the promise, or 0 if a value was set.
+   */
+  int error() const {
+    _s->wait((uint32)-1);
+    return _s->err;
+  }
+
+private:
+  template <typename> friend class Promise;
+  explicit Future(xx::FutureState<T> *s) : _s(xx::ref(s)) {}
+
+  xx::FutureState<T> *_s;
+};
+
+/**
+ * co::Promise is the producing side of a co::Future
+ *   - Only the first set_value() or set_error() takes effect.
+ *   - It is copyable, so it can be captured by value in a lambda.
+ *   - Users MUST set a result, or waiters of the future will never wake up.
+ *
+ *   - usage:
+ *     co::Promise<int> p;
+ *     auto f = p.get_future();
+ *     go([p]() { p.set_value(7); });
+ *     f.get();  // 7
+ */
+template <typename T> class Promise {
+public:
+  Promise() : _s(new xx::FutureState<T>) {}
+  ~Promise() { xx::unref(_s); }
+
+  Promise(Promise &&p) : _s(p._s) { p._s = 0; }
+
+  Promise(const Promise &p) : _s(xx::ref(p._s)) {}
+
+  void operator=(const Promise &) = delete;
+
+  Future<T> get_future() const { return Future<T>(_s); }
+
+  /**
+   * set the value and wake up the waiters
+   *
+   * @return  true on success, false if a result has already been set.
+   */
+  template <typename V> bool set_value(V &&v) const {
+    if (!_s->begin_set())
+      return false;
+    _s->value = std::forward<V>(v);
+    _s->end_set(xx::FutureState<T>::st_value);
+    return true;
+  }
+
+  /**
+   * set an error and wake up the waiters
+   *
+   * @param err  a non-zero error code.
+   *
+   * @return     true on success, false if a result has already been set.
+   */
+  bool set_error(int err) const {
+    if (!_s->begin_set())
+      return false;
+    _s->err = err;
+    _s->end_set(xx::FutureState<T>::st_error);
+    return true;
+  }
+
+private:
+  xx::FutureState<T> *_s;
+};
+
+} // namespace co
@@ -9,6 +9,9 @@ namespace co {
  * co::Mutex is a mutex lock for coroutines
  *   - It is similar to Mutex for threads.
  *   - Users SHOULD use co::Mutex in coroutine environments only.
+ *   - On contention, it spins for a while before the coroutine is suspended.
+ *     If a waiting coroutine starves, the lock will be handed over to waiters
+ *     in FIFO order until no coroutine is waiting.
  */
 class __codec Mutex {
 public:
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "../co.h"
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace co {
+namespace xx {
+
+// A range of indexes owned by a scheduler. Chunks are taken from the front
+// with an atomic add, by the owner first, and by other schedulers when they
+// have finished their own ranges.
+struct ParallelRange {
+  size_t next;
+  size_t end;
+  char _pad[64 - 2 * sizeof(size_t)];
+};
+
+inline bool take_chunk(ParallelRange &r, size_t grain, size_t &b, size_t &e) {
+  if (atomic_get(&r.next) >= r.end)
+    return false;
+  b = atomic_fetch_add(&r.next, grain);
+  if (b >= r.end)
+    return false;
+  e = r.end - b > grain ? b + grain : r.end;
+  return true;
+}
+
+// Run body(k, b, e) for chunks of [begin, end) on all schedulers, k is the
+// index of the worker. The body MUST be allocated on heap, as the stack of
+// the calling coroutine may be swapped out while it is waiting.
+template <typename B>
+void parallel_run(size_t begin, size_t end, size_t grain, B *body) {
+  auto &scheds = co::all_schedulers();
+  const size_t n = scheds.size();
+  const size_t count = end - begin;
+  if (grain == 0) {
+    grain = count / (n * 16);
+    if (grain == 0)
+      grain = 1;
+  }
+
+  // nothing to share with others
+  if (count <= grain) {
+    body->run(n, begin, end);
+    return;
+  }
+
+  std::unique_ptr<ParallelRange[]> rs(new ParallelRange[n]);
+  for (size_t k = 0; k < n; ++k) {
+    rs[k].next = begin + count * k / n;
+    rs[k].end = begin + count * (k + 1) / n;
+  }
+
+  auto work = [](ParallelRange *rs, size_t n, size_t k, size_t grain,
+                 B *body) {
+    size_t b, e;
+    for (size_t x = 0; x < n; ++x) {
+      ParallelRange &r = rs[(k + x) % n];
+      while (take_chunk(r, grain, b, e))
+        body->run(k, b, e);
+    }
+  };
+
+  const int cur = co::scheduler_id();
+  const uint32 m = cur >= 0 ? (uint32)n - 1 : (uint32)n;
+  ParallelRange *p = rs.get();
+  co::WaitGroup wg;
+  wg.add(m);
+  for (size_t k = 0; k < n; ++k) {
+    if ((int)k == cur)
+      continue;
+    scheds[k]->go([work, p, n, k, grain, body, wg]() {
+      work(p, n, k, grain, body);
+      wg.done();
+    });
+  }
+
+  // The caller works on its own range in a coroutine, or helps others as an
+  // extra worker in a non-scheduler thread.
+  work(p, n, cur >= 0 ? (size_t)cur : n, grain, body);
+  if (m > 0)
+    wg.wait();
+}
+
+template <typename F> struct ParallelFor {
+  explicit ParallelFor(F &&fn) : f(std::forward<F>(fn)) {}
+
+  void run(size_t, size_t b, size_t e) {
+    for (size_t i = b; i < e; ++i)
+      f(i);
+  }
+
+  typename std::decay<F>::type f;
+};
+
+template <typename T, typename M, typename R> struct ParallelReduce {
+  ParallelReduce(size_t n, const T &identity, M &&m, R &&r)
+      : acc(n + 1, Slot{identity, {0}}), map(std::forward<M>(m)),
+        reduce(std::forward<R>(r)) {}
+
+  // accumulate in a local variable, the accumulator is written once
+  void run(size_t k, size_t b, size_t e) {
+    T a = acc[k].v;
+    for (size_t i = b; i < e; ++i)
+      a = reduce(a, map(i));
+    acc[k].v = std::move(a);
+  }
+
+  // Workers write their accumulators concurrently. Each one is wrapped in a
+  // slot padded by a cache line, so that they never share a word, as bits of
+  // std::vector<bool> do, or a cache line.
+  struct Slot {
+    T v;
+    char pad[64];
+  };
+
+  std::vector<Slot> acc; // one accumulator for each worker
+  typename std::decay<M>::type map;
+  typename std::decay<R>::type reduce;
+};
+
+} // namespace xx
+
+/**
+ * run f(i) for each i in [begin, end) on all schedulers
+ *   - It can be called from anywhere, and blocks until all work is done.
+ *   - The range is split into a sub range for each scheduler, and each
+ *     scheduler takes chunks of `grain` indexes from its own sub range. A
+ *     scheduler that has finished its own range steals chunks from others.
+ *   - When called in a coroutine, the calling coroutine works on the sub range
+ *     of its scheduler. When called in a non-scheduler thread, the thread
+ *     takes part in the work as an extra worker.
+ *   - NOTE: f runs on other schedulers while the calling coroutine is waiting,
+ *     and the stack of a waiting coroutine may be swapped out. Data used by f
+ *     SHOULD NOT be on the stack of the calling coroutine.
+ *
+ * @param begin  the first index.
+ * @param end    the index after the last one.
+ * @param grain  number of indexes in a chunk, 0 to choose it automatically.
+ * @param f      a function like `void f(size_t i)`.
+ */
+template <typename F>
+void parallel_for(size_t begin, size_t end, size_t grain, F &&f) {
+  if (end <= begin)
+    return;
+  std::unique_ptr<xx::ParallelFor<F>> body(
+      new xx::ParallelFor<F>(std::forward<F>(f)));
+  xx::parallel_run(begin, end, grain, body.get());
+}
+
+/**
+ * map each i in [begin, end) to a value, and reduce the values into one
+ *   - Work is shared between schedulers in the same way as parallel_for().
+ *   - Each worker reduces the values of its chunks into its own accumulator,
+ *     and the accumulators are reduced in the calling thread at last.
+ *   - reduce MUST be associative and commutative, as the order of the values
+ *     is not specified.
+ *
+ *   - usage:
+ *     uint64 sum = co::parallel_reduce(0, n, 0, (uint64)0,
+ *         [&v](size_t i) { return (uint64)v[i]; },
+ *         [](uint64 a, uint64 b) { return a + b; }
+ *     );
+ *
+ * @param identity  the identity value of reduce, 0 for sum, 1 for product...
+ * @param map       a function like `T map(size_t i)`.
+ * @param reduce    a function like `T reduce(const T& a, const T& b)`.
+ *
+ * @return          the reduced value, or identity if the range is empty.
+ */
+template <typename T, typename M, typename R>
+T parallel_reduce(size_t begin, size_t end, size_t grain, const T &identity,
+                  M &&map, R &&reduce) {
+  if (end <= begin)
+    return identity;
+  typedef xx::ParallelReduce<T, M, R> B;
+  std::unique_ptr<B> body(new B(co::all_schedulers().size(), identity,
+                                std::forward<M>(map),
+                                std::forward<R>(reduce)));
+  xx::parallel_run(begin, end, grain, body.get());
+
+  T r = identity;
+  for (auto &a : body->acc)
+    r = body->reduce(r, a.v);
+  return r;
+}
+
+} // namespace co
@@ -16,6 +16,11 @@ namespace co {
  *
  *   - NOTE: Each thread holds its own pool, users SHOULD call pop() and push()
  *     in the same thread.
+ *   - An optional shared tier can be set to move elements between threads.
+ *     Elements overflowed from a full pool go to the shared tier, and pop()
+ *     takes elements from it when the pool of the current thread is empty.
+ *     The number of idle elements is then bounded by
+ *     `cap * scheduler_num + shared_cap`.
  */
 class __codec Pool {
 public:
@@ -30,12 +35,17 @@ public:
    *             it is used to create an element when pop from an empty pool.
    * @param dcb  a destroy callback like:  [](void* p) { delete (T*)p; }
    *             it is used to destroy an element.
-   * @param cap  max capacity of the pool for each thread, -1 for unlimited.
-   *             this argument is ignored if dcb is NULL.
-   *             default: -1.
+   * @param cap         max capacity of the pool for each thread, -1 for
+   *                    unlimited. this argument is ignored if dcb is NULL.
+   *                    default: -1.
+   * @param shared_cap  capacity of the shared tier, 0 for no shared tier.
+   *                    default: 0.
+   * @param idle_ms     elements idle for more than idle_ms milliseconds will
+   *                    be destroyed by dcb, 0 for never. this argument is
+   *                    ignored if dcb is NULL. default: 0.
    */
   Pool(std::function<void *()> &&ccb, std::function<void(void *)> &&dcb,
-       size_t cap = (size_t)-1);
+       size_t cap = (size_t)-1, size_t shared_cap = 0, uint32 idle_ms = 0);
 
   Pool(Pool &&p) : _p(p._p) { p._p = 0; }
 
@@ -46,8 +56,9 @@ public:
   /**
    * pop an element from the pool of the current thread
    *   - It MUST be called in a coroutine.
-   *   - If the pool is empty and ccb is set, ccb() will be called to create a
-   * new element.
+   *   - If the pool is empty, an element will be taken from the shared tier.
+   *     If there is none and ccb is set, ccb() will be called to create a new
+   *     element.
    *
    * @return  a pointer to an element, or NULL if pool is empty and ccb is not
    * set.
@@ -66,6 +77,7 @@ public:
   /**
    * return pool size of the current thread
    *   - It MUST be called in a coroutine.
+   *   - Elements in the shared tier are not counted.
    */
   size_t size() const;
 
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../def.h"
+#include "../atomic.h"
+
+namespace co {
+
+/**
+ * co::RWMutex is a reader-writer lock for coroutines
+ *   - Any number of readers or a single writer can hold the lock.
+ *   - Writers are preferred. Once a writer is waiting for the lock, new readers
+ *     will be blocked until the writer releases the lock.
+ *   - Readers acquire and release the lock with a single atomic operation if
+ *     no writer is present, so readers on all schedulers can run in parallel.
+ *   - Users SHOULD use co::RWMutex in coroutine environments only.
+ */
+class __codec RWMutex {
+public:
+  RWMutex();
+  ~RWMutex();
+
+  RWMutex(RWMutex &&m) : _p(m._p) { m._p = 0; }
+
+  RWMutex(const RWMutex &m) : _p(m._p) { atomic_inc(_p); }
+
+  void operator=(const RWMutex &) = delete;
+
+  /**
+   * acquire the lock for writing
+   *   - It MUST be called in a coroutine.
+   *   - It blocks until all readers and the other writer released the lock.
+   */
+  void lock() const;
+
+  /**
+   * release the write lock
+   *   - It SHOULD be called in the coroutine that holds the write lock.
+   *   - Readers blocked by this writer will be waken up.
+   */
+  void unlock() const;
+
+  /**
+   * try to acquire the lock for writing
+   *
+   * @return  true if the write lock was acquired, otherwise false.
+   */
+  bool try_lock() const;
+
+  /**
+   * acquire the lock for reading
+   *   - It MUST be called in a coroutine.
+   *   - It blocks while a writer holds the lock or is waiting for it.
+   */
+  void rlock() const;
+
+  /**
+   * release the read lock
+   *   - It SHOULD be called in the coroutine that holds the read lock.
+   */
+  void runlock() const;
+
+  /**
+   * try to acquire the lock for reading
+   *
+   * @return  true if the read lock was acquired, otherwise false.
+   */
+  bool try_rlock() const;
+
+private:
+  uint32 *_p;
+};
+
+/**
+ * guard to release the read lock
+ *   - rlock() is called in the constructor.
+ *   - runlock() is called in the destructor.
+ */
+class __codec RLockGuard {
+public:
+  explicit RLockGuard(const co::RWMutex &lock) : _lock(lock) { _lock.rlock(); }
+
+  explicit RLockGuard(const co::RWMutex *lock) : _lock(*lock) {
+    _lock.rlock();
+  }
+
+  ~RLockGuard() { _lock.runlock(); }
+
+private:
+  const co::RWMutex &_lock;
+  DISALLOW_COPY_AND_ASSIGN(RLockGuard);
+};
+
+/**
+ * guard to release the write lock
+ *   - lock() is called in the constructor.
+ *   - unlock() is called in the destructor.
+ */
+class __codec WLockGuard {
+public:
+  explicit WLockGuard(const co::RWMutex &lock) : _lock(lock) { _lock.lock(); }
+
+  explicit WLockGuard(const co::RWMutex *lock) : _lock(*lock) { _lock.lock(); }
+
+  ~WLockGuard() { _lock.unlock(); }
+
+private:
+  const co::RWMutex &_lock;
+  DISALLOW_COPY_AND_ASSIGN(WLockGuard);
+};
+
+} // namespace co
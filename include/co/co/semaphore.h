@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../def.h"
+#include "../atomic.h"
+
+namespace co {
+
+/**
+ * co::Semaphore is a counting semaphore for coroutines
+ *   - Waiters are served in FIFO order. A waiter blocks the ones behind it
+ *     until its request can be satisfied, so that acquire_n() with a large n
+ *     will not be starved by small requests.
+ *   - acquire() MUST be called in a coroutine, while release() can be called
+ *     anywhere.
+ */
+class __codec Semaphore {
+public:
+  /**
+   * @param n  the initial count of the semaphore, 0 by default.
+   */
+  explicit Semaphore(uint32 n = 0);
+  ~Semaphore();
+
+  Semaphore(Semaphore &&s) : _p(s._p) { s._p = 0; }
+
+  Semaphore(const Semaphore &s) : _p(s._p) { atomic_inc(_p); }
+
+  void operator=(const Semaphore &) = delete;
+
+  /**
+   * acquire one resource, block until it is available
+   *   - It MUST be called in a coroutine.
+   */
+  void acquire() const;
+
+  /**
+   * acquire one resource with a timeout
+   *   - It MUST be called in a coroutine.
+   *
+   * @param ms  timeout in milliseconds, -1 for never timeout.
+   *
+   * @return    true if the resource was acquired, false on timeout.
+   */
+  bool acquire(uint32 ms) const;
+
+  /**
+   * acquire n resources at once
+   *   - It MUST be called in a coroutine.
+   *   - Nothing will be acquired if it returns false.
+   *
+   * @param n   number of resources to acquire.
+   * @param ms  timeout in milliseconds, -1 for never timeout.
+   *
+   * @return    true if the resources were acquired, false on timeout.
+   */
+  bool acquire_n(uint32 n, uint32 ms = (uint32)-1) const;
+
+  /**
+   * try to acquire n resources without blocking
+   *   - It fails if other coroutines are waiting for the semaphore.
+   *
+   * @return  true if the resources were acquired, otherwise false.
+   */
+  bool try_acquire(uint32 n = 1) const;
+
+  /**
+   * release n resources
+   *   - Waiters that can be satisfied will be waken up.
+   */
+  void release(uint32 n = 1) const;
+
+private:
+  uint32 *_p;
+};
+
+} // namespace co
@@ -24,6 +24,7 @@ typedef SOCKET sock_t;
 #include <netinet/tcp.h> // for TCP_NODELAY...
 #include <arpa/inet.h>   // for inet_ntop...
 #include <netdb.h>       // getaddrinfo, gethostby...
+#include <sys/uio.h>     // for struct iovec
 
 typedef int sock_t;
 #endif
@@ -44,6 +45,16 @@ __codec const char *strerror(int e);
 // get string of the current error number (thread-safe)
 inline const char *strerror() { return co::strerror(co::error()); }
 
+#ifdef _WIN32
+// the same as struct iovec on posix systems
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#else
+using ::iovec;
+#endif
+
 /**
  * create a socket suitable for coroutine programing
  *
@@ -168,6 +179,33 @@ __codec sock_t accept(sock_t fd, void *addr, int *addrlen);
  */
 __codec int connect(sock_t fd, const void *addr, int addrlen, int ms = -1);
 
+/**
+ * connect to an address and send data with TCP Fast Open
+ *   - It MUST be called in a coroutine.
+ *   - It blocks until the connection was done and all the data was sent, or
+ * timeout, or any error occured.
+ *   - On linux, data is sent with the SYN by sendto() with MSG_FASTOPEN, if
+ * the client has got a TFO cookie from the server. The first connection to a
+ * server only gets the cookie, and data is sent after the handshake. It falls
+ * back to co::connect() and co::send() if TFO is not enabled for clients by
+ * net.ipv4.tcp_fastopen, or on other platforms.
+ *   - The server MUST accept data in the SYN, see FLG_tcp_fastopen in
+ * co/so/tcp.h. The data may be delivered more than once if the SYN was
+ * duplicated, so it SHOULD be an idempotent request.
+ *
+ * @param fd       a non-blocking TCP socket, not connected.
+ * @param addr     a pointer to struct sockaddr, sockaddr_in or sockaddr_in6.
+ * @param addrlen  size of the structure pointed to by addr.
+ * @param buf      a pointer to a buffer of the data to be sent.
+ * @param n        size of the data, MUST be greater than 0.
+ * @param ms       timeout in milliseconds, if ms < 0, never timed out.
+ *                 default: -1.
+ *
+ * @return         n on success, -1 on timeout or error.
+ */
+__codec int connect_fastopen(sock_t fd, const void *addr, int addrlen,
+                             const void *buf, int n, int ms = -1);
+
 /**
  * recv data from a socket
  *   - It MUST be called in a coroutine.
@@ -272,6 +310,189 @@ __codec int send(sock_t fd, const void *buf, int n, int ms = -1);
 __codec int sendto(sock_t fd, const void *buf, int n, const void *dst_addr,
                    int addrlen, int ms = -1);
 
+/**
+ * recv data on a socket into multiple buffers
+ *   - It MUST be called in a coroutine.
+ *   - It blocks until any data recieved or timeout, or any error occured.
+ *   - Buffers are filled in order, like readv().
+ *
+ * @param fd   a non-blocking (also overlapped on windows) socket.
+ * @param iov  an array of co::iovec (struct iovec on posix systems).
+ * @param n    number of elements in iov.
+ * @param ms   timeout in milliseconds, if ms < 0, it will never time out.
+ *             default: -1.
+ *
+ * @return     bytes recieved on success, -1 on timeout or error, 0 will be
+ *             returned if fd is a stream socket and the peer has closed the
+ *             connection.
+ */
+__codec int recvv(sock_t fd, const iovec *iov, int n, int ms = -1);
+
+/**
+ * send data in multiple buffers on a socket
+ *   - It MUST be called in a coroutine.
+ *   - It blocks until all data in the buffers are sent or timeout, or any
+ * error occured.
+ *   - Data is sent by writev() on posix systems, without copying the buffers
+ * together. A partial write is resumed from where it stopped.
+ *   - Total size of the buffers MUST be less than 2G.
+ *
+ * @param fd   a non-blocking (also overlapped on windows) socket.
+ * @param iov  an array of co::iovec (struct iovec on posix systems).
+ * @param n    number of elements in iov.
+ * @param ms   timeout in milliseconds, if ms < 0, it will never time out.
+ *             default: -1.
+ *
+ * @return     total size of the buffers on success, or -1 on error.
+ */
+__codec int sendv(sock_t fd, const iovec *iov, int n, int ms = -1);
+
+#ifndef _WIN32
+/**
+ * send n bytes on a socket without copying them to the kernel
+ *   - It MUST be called in a coroutine.
+ *   - It sets SO_ZEROCOPY on the socket at the first call, and sends data with
+ * MSG_ZEROCOPY. The socket MUST be closed with co::close(), which clears the
+ * state of zerocopy sends on it.
+ * The kernel reads the data from the buffer directly, and reports the
+ * completion on the error queue of the socket. This function waits for the
+ * completions in the scheduler, and returns only after the kernel has released
+ * the buffer, so the buffer can be reused or freed once it returns.
+ *   - It pays off only for large buffers, as pinning pages and reading the
+ * completions are not free. The kernel may still copy the data, e.g. on the
+ * loopback interface. Run test/so/zerocopy.cc to find the threshold.
+ *   - On platforms without MSG_ZEROCOPY, or if SO_ZEROCOPY is not supported by
+ * the socket, it is the same as co::send().
+ *   - Only one coroutine should call it on a socket at the same time.
+ *
+ * @param fd   a non-blocking TCP socket.
+ * @param buf  a pointer to a buffer of the data to be sent.
+ * @param n    size of the data.
+ * @param ms   timeout in milliseconds, if ms < 0, it will never time out.
+ *             default: -1.
+ *
+ * @return     n on success, or -1 on error. On error or timeout, the buffer
+ *             may still be used by the kernel until the socket is closed.
+ */
+__codec int send_zerocopy(sock_t fd, const void *buf, int n, int ms = -1);
+
+/**
+ * send data of a file on a socket
+ *   - It MUST be called in a coroutine.
+ *   - It blocks until n bytes are sent, or the end of the file is reached, or
+ * timeout, or any error occured.
+ *   - On linux, data is sent by sendfile() without copying to user space. On
+ * other platforms, data is read to a buffer and sent by co::send().
+ *
+ * @param fd       a non-blocking socket, usually a TCP socket.
+ * @param file_fd  a file descriptor opened for reading.
+ * @param off      offset in the file where to start reading.
+ * @param n        bytes to be sent.
+ * @param ms       timeout in milliseconds, if ms < 0, it will never time out.
+ *                 default: -1.
+ *
+ * @return         bytes sent on success, which is less than n only if the end
+ *                 of the file was reached, or -1 on timeout or error.
+ */
+__codec int64 sendfile(sock_t fd, int file_fd, int64 off, int64 n,
+                       int ms = -1);
+
+/**
+ * move data from one socket to another
+ *   - It MUST be called in a coroutine.
+ *   - It blocks until n bytes are moved, or the peer of @from closed the
+ * connection, or timeout, or any error occured.
+ *   - On linux, data is moved by splice() through a pipe without copying to
+ * user space. On other platforms, it uses co::recv() and co::send().
+ *   - Users may set n to a large value to proxy a connection until EOF.
+ *
+ * @param from  a non-blocking socket to read data from.
+ * @param to    a non-blocking socket to write data to.
+ * @param n     bytes to be moved.
+ * @param ms    timeout in milliseconds for each wait, if ms < 0, it will never
+ *              time out. default: -1.
+ *
+ * @return      bytes moved on success, which is less than n only if the peer
+ *              closed the connection, or -1 on timeout or error.
+ */
+__codec int64 splice(sock_t from, sock_t to, int64 n, int ms = -1);
+
+#ifdef __linux__
+using ::mmsghdr;
+#else
+// the same as struct mmsghdr on linux
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+#endif
+
+/**
+ * recv multiple datagrams on a socket
+ *   - It MUST be called in a coroutine.
+ *   - It blocks until at least one datagram was recieved or timeout, or any
+ * error occured, and then returns datagrams already queued in the socket, up
+ * to n.
+ *   - On linux, datagrams are received by recvmmsg() in one syscall. On other
+ * platforms, it calls recvmsg() for each datagram.
+ *   - msg_len of each message is set to size of the datagram received. For
+ * messages with msg_name, msg_namelen is set to size of the source address.
+ *
+ * @param fd    a non-blocking udp socket.
+ * @param msgs  an array of co::mmsghdr (struct mmsghdr on linux).
+ * @param n     number of elements in msgs.
+ * @param ms    timeout in milliseconds, if ms < 0, it will never time out.
+ *              default: -1.
+ *
+ * @return      number of datagrams received on success, -1 on timeout or
+ *              error.
+ */
+__codec int recvmmsg(sock_t fd, mmsghdr *msgs, int n, int ms = -1);
+
+/**
+ * send multiple datagrams on a socket
+ *   - It MUST be called in a coroutine.
+ *   - It blocks until all the n datagrams are sent or timeout, or any error
+ * occured.
+ *   - On linux, datagrams are sent by sendmmsg() in as few syscalls as
+ * possible. On other platforms, it calls sendmsg() for each datagram.
+ *   - msg_len of each message is set to bytes sent.
+ *
+ * @param fd    a non-blocking udp socket.
+ * @param msgs  an array of co::mmsghdr (struct mmsghdr on linux).
+ * @param n     number of elements in msgs.
+ * @param ms    timeout in milliseconds, if ms < 0, it will never time out.
+ *              default: -1.
+ *
+ * @return      n on success, -1 on timeout or error. Datagrams before the one
+ *              failed may have been sent.
+ */
+__codec int sendmmsg(sock_t fd, mmsghdr *msgs, int n, int ms = -1);
+
+/**
+ * enable UDP generic segmentation offload (UDP_SEGMENT) on a socket
+ *   - A buffer passed to send() or sendto() is split into datagrams of the
+ * segment size by the kernel or the NIC, so one syscall sends up to 64 KB.
+ *   - Linux 4.18+ only, it fails with ENOPROTOOPT on other platforms.
+ *
+ * @param size  size of each datagram, not including the headers.
+ *
+ * @return      0 on success, -1 on error.
+ */
+__codec int set_udp_gso(sock_t fd, int size);
+
+/**
+ * enable UDP generic receive offload (UDP_GRO) on a socket
+ *   - Datagrams of the same flow may be coalesced into one buffer, and the
+ * segment size is delivered in a UDP_GRO control message. Users MUST pass
+ * msg_control to co::recvmmsg() to get it and split the buffer.
+ *   - Linux 5.0+ only, it fails with ENOPROTOOPT on other platforms.
+ *
+ * @return  0 on success, -1 on error.
+ */
+__codec int set_udp_gro(sock_t fd);
+#endif
+
 #ifdef _WIN32
 /**
  * get options on a socket, man getsockopt for details.
@@ -463,11 +684,16 @@ inline fastring to_string(const struct sockaddr_in6 *addr) {
  *
  * @param addr  a pointer to struct sockaddr.
  * @param len   length of the addr, sizeof(sockaddr_in) or sizeof(sockaddr_in6).
+ *
+ * @return      a string in format "ip:port", or an empty string for other
+ *              addresses, e.g. a unix domain socket address.
  */
 inline fastring to_string(const void *addr, int len) {
   if (len == sizeof(sockaddr_in))
     return to_string((const sockaddr_in *)addr);
-  return to_string((const struct sockaddr_in6 *)addr);
+  if (len == sizeof(sockaddr_in6))
+    return to_string((const struct sockaddr_in6 *)addr);
+  return fastring();
 }
 
 /**
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "../co.h"
+#include "../time.h"
+#include <errno.h>
+#include <deque>
+
+namespace co {
+namespace xx {
+
+template <typename T> struct TaskGroupState {
+  struct Slot {
+    Slot() : value(), err(0) {}
+    T value;
+    int err;
+  };
+
+  TaskGroupState() : refn(1), pending(0), cancelled(0), err(0), first(-1) {}
+
+  uint32 refn;
+  uint32 pending;   // number of tasks not finished
+  uint32 cancelled; // 1 if the group was cancelled
+  int err;          // the first error
+  int first;        // index of the first task finished without error
+  co::Event ev;     // signaled when a task is finished
+  std::deque<Slot> slots;
+};
+
+} // namespace xx
+
+/**
+ * co::TaskGroup runs tasks in coroutines and collects their results
+ *   - A task is a function like `int f(T& r)`, it stores the result in r, and
+ *     returns 0 on success, or a non-zero error code.
+ *   - The first error is kept by the group, and the group is cancelled then.
+ *     Tasks not started yet will be skipped with ECANCELED, and running tasks
+ *     may check cancelled() to give up early. ECANCELED returned by a task is
+ *     not taken as an error of the group.
+ *   - A finished task wakes up the waiter directly, no extra thread hop.
+ *   - go(), wait_all() and wait_any() SHOULD be called by the same coroutine
+ *     or thread, the owner of the group. It is copyable, so tasks can capture
+ *     it by value to check cancelled().
+ *   - T MUST be default constructible.
+ *
+ *   - usage:
+ *     co::TaskGroup<int> g;
+ *     for (int i = 0; i < 8; ++i) {
+ *         g.go([i](int& r) { r = i * i; return 0; });
+ *     }
+ *     g.wait_all();
+ *     if (g.error() == 0) g.result(3);  // 9
+ */
+template <typename T> class TaskGroup {
+public:
+  typedef xx::TaskGroupState<T> S;
+
+  TaskGroup() : _s(new S) {}
+
+  ~TaskGroup() { unref(_s); }
+
+  TaskGroup(TaskGroup &&g) : _s(g._s) { g._s = 0; }
+
+  TaskGroup(const TaskGroup &g) : _s(g._s) { atomic_inc(&_s->refn); }
+
+  void operator=(const TaskGroup &) = delete;
+
+  /**
+   * run a task in a coroutine
+   *
+   * @param f  a function like `int f(T& r)`.
+   *
+   * @return   index of the task, which starts from 0.
+   */
+  template <typename F> size_t go(F &&f) const {
+    S *s = _s;
+    const size_t i = s->slots.size();
+    s->slots.emplace_back();
+    auto *slot = &s->slots.back();
+    atomic_inc(&s->refn);
+    atomic_inc(&s->pending);
+
+    co::go([s, slot, i, f]() mutable {
+      int e = ECANCELED;
+      if (!atomic_get(&s->cancelled))
+        e = f(slot->value);
+      slot->err = e;
+      if (e == 0) {
+        atomic_compare_swap(&s->first, -1, (int)i);
+      } else if (e != ECANCELED) {
+        if (atomic_compare_swap(&s->err, 0, e) == 0)
+          atomic_set(&s->cancelled, 1);
+      }
+      atomic_dec(&s->pending);
+      s->ev.signal();
+      unref(s);
+    });
+    return i;
+  }
+
+  /**
+   * wait for all tasks to finish
+   *
+   * @param ms  timeout in milliseconds, -1 for never timeout.
+   *
+   * @return    true if all tasks were finished, false on timeout.
+   */
+  bool wait_all(uint32 ms = (uint32)-1) const {
+    return this->wait_until(
+        ms, [](S *s) { return atomic_get(&s->pending) == 0; });
+  }
+
+  /**
+   * wait for the first task that finishes without error
+   *
+   * @param ms  timeout in milliseconds, -1 for never timeout.
+   *
+   * @return    index of the task, or -1 if all tasks failed or timed out.
+   */
+  int wait_any(uint32 ms = (uint32)-1) const {
+    this->wait_until(ms, [](S *s) {
+      return atomic_get(&s->first) >= 0 || atomic_get(&s->pending) == 0;
+    });
+    return atomic_get(&_s->first);
+  }
+
+  // cancel the group, tasks not started yet will be skipped
+  void cancel() const { atomic_set(&_s->cancelled, 1); }
+
+  bool cancelled() const { return atomic_get(&_s->cancelled) != 0; }
+
+  // the first error of the group, 0 if no task failed
+  int error() const { return atomic_get(&_s->err); }
+
+  // number of tasks added by go()
+  size_t size() const { return _s->slots.size(); }
+
+  // result of the i-th task, it is valid after the task was finished
+  T &result(size_t i) const { return _s->slots[i].value; }
+
+  // error of the i-th task, it is valid after the task was finished
+  int error(size_t i) const { return _s->slots[i].err; }
+
+private:
+  static void unref(S *s) {
+    if (s && atomic_dec(&s->refn) == 0)
+      delete s;
+  }
+
+  // Every finished task signals the event, the owner checks the condition
+  // again when it is woken up.
+  template <typename C> bool wait_until(uint32 ms, C &&done) const {
+    const int64 deadline = ms == (uint32)-1 ? 0 : now::ms() + ms;
+    while (!done(_s)) {
+      uint32 t = (uint32)-1;
+      if (ms != (uint32)-1) {
+        const int64 x = deadline - now::ms();
+        if (x <= 0)
+          return false;
+        t = (uint32)x;
+      }
+      _s->ev.wait(t);
+    }
+    return true;
+  }
+
+  S *_s;
+};
+
+} // namespace co
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "../co.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace co {
+namespace xx {
+
+template <typename T> struct default_create {
+  T *operator()() const { return new T(); }
+};
+
+} // namespace xx
+
+/**
+ * a typed pool for coroutine programming
+ *   - It is similar to co::Pool, but it stores T* and the create and destroy
+ *     callbacks are template parameters, so they can be inlined.
+ *   - Each scheduler holds its own pool, pop() and push() SHOULD be called in
+ *     the same scheduler, and they need no lock.
+ *   - Hit, miss and overflow counters are kept for each scheduler, stats()
+ *     adds them up. Counters of other schedulers may be slightly out of date.
+ *   - It is not copyable, share it by reference or pointer.
+ *
+ *   - usage:
+ *     struct T { void hello(); };
+ *     struct CreateT { T* operator()() const { return new T(); } };
+ *     co::TypedPool<T, CreateT> pool(64);
+ *     pool.warm_up(8);
+ *
+ *     co::TypedPoolGuard<T, CreateT> g(pool);
+ *     g->hello();
+ */
+template <typename T, typename Create = xx::default_create<T>,
+          typename Destroy = std::default_delete<T>>
+class TypedPool {
+public:
+  struct Stats {
+    uint64 hit;      // pop() got an element from the pool
+    uint64 miss;     // pop() created a new element by Create
+    uint64 overflow; // push() destroyed an element as the pool was full
+  };
+
+  /**
+   * @param cap  max capacity of the pool for each scheduler, -1 for unlimited.
+   *             default: -1.
+   */
+  explicit TypedPool(size_t cap = (size_t)-1)
+      : _pools(co::scheduler_num()), _cap(cap) {}
+
+  /**
+   * destroy all elements in the pools
+   *   - The pool MUST NOT be used by others when it is destroyed.
+   */
+  ~TypedPool() {
+    for (auto &l : _pools) {
+      for (auto &p : l.v)
+        _destroy(p);
+    }
+  }
+
+  /**
+   * pop an element from the pool of the current scheduler
+   *   - It MUST be called in a coroutine.
+   *   - If the pool is empty, a new element will be created by Create.
+   */
+  T *pop() {
+    Local &l = this->local();
+    if (!l.v.empty()) {
+      ++l.hit;
+      T *p = l.v.back();
+      l.v.pop_back();
+      return p;
+    }
+    ++l.miss;
+    return _create();
+  }
+
+  /**
+   * push an element to the pool of the current scheduler
+   *   - It MUST be called in a coroutine.
+   *   - If the pool is full, the element will be destroyed by Destroy.
+   *
+   * @param p  a pointer to an element, NULL pointers will be ignored.
+   */
+  void push(T *p) {
+    if (!p)
+      return;
+    Local &l = this->local();
+    if (l.v.size() < _cap) {
+      l.v.push_back(p);
+    } else {
+      ++l.overflow;
+      _destroy(p);
+    }
+  }
+
+  /**
+   * fill the pool of each scheduler with up to n elements
+   *   - It can be called from anywhere, and blocks until all pools are filled.
+   *   - Elements are created in the schedulers that own the pools.
+   */
+  void warm_up(size_t n) {
+    if (n > _cap)
+      n = _cap;
+    this->for_each_scheduler([this, n]() {
+      Local &l = this->local();
+      while (l.v.size() < n)
+        l.v.push_back(_create());
+    });
+  }
+
+  /**
+   * clear pools of all schedulers
+   *   - It can be called from anywhere, and blocks until all pools are clear.
+   */
+  void clear() {
+    this->for_each_scheduler([this]() {
+      Local &l = this->local();
+      std::vector<T *> v;
+      v.swap(l.v);
+      for (auto &p : v)
+        _destroy(p);
+    });
+  }
+
+  /**
+   * return pool size of the current scheduler
+   *   - It MUST be called in a coroutine.
+   */
+  size_t size() const {
+    const int id = co::scheduler_id();
+    CHECK(id >= 0) << "must be called in coroutine..";
+    return _pools[id].v.size();
+  }
+
+  /**
+   * return counters added up from all schedulers
+   */
+  Stats stats() const {
+    Stats s = {0, 0, 0};
+    for (auto &l : _pools) {
+      s.hit += l.hit;
+      s.miss += l.miss;
+      s.overflow += l.overflow;
+    }
+    return s;
+  }
+
+private:
+  // pad to a cache line, schedulers do not share cache lines with each other
+  struct Local {
+    Local() : hit(0), miss(0), overflow(0) {}
+    std::vector<T *> v;
+    uint64 hit;
+    uint64 miss;
+    uint64 overflow;
+    char _pad[64 - (sizeof(std::vector<T *>) + 24) % 64];
+  };
+
+  Local &local() {
+    const int id = co::scheduler_id();
+    CHECK(id >= 0) << "must be called in coroutine..";
+    return _pools[id];
+  }
+
+  // f is copied to heap, as the stack of the calling coroutine may be swapped
+  // out while it is waiting, and a reference to it would be dangling then.
+  template <typename F> void for_each_scheduler(F &&f) {
+    auto &scheds = co::all_schedulers();
+    std::shared_ptr<std::function<void()>> g =
+        std::make_shared<std::function<void()>>(std::forward<F>(f));
+    co::WaitGroup wg;
+    wg.add((uint32)scheds.size());
+    for (auto &s : scheds) {
+      s->go([g, wg]() {
+        (*g)();
+        wg.done();
+      });
+    }
+    wg.wait();
+  }
+
+  std::vector<Local> _pools;
+  size_t _cap;
+  Create _create;
+  Destroy _destroy;
+  DISALLOW_COPY_AND_ASSIGN(TypedPool);
+};
+
+/**
+ * guard to push an element back to co::TypedPool
+ *   - TypedPool::pop() is called in the constructor.
+ *   - TypedPool::push() is called in the destructor.
+ */
+template <typename T, typename Create = xx::default_create<T>,
+          typename Destroy = std::default_delete<T>>
+class TypedPoolGuard {
+public:
+  typedef TypedPool<T, Create, Destroy> P;
+
+  explicit TypedPoolGuard(P &pool) : _pool(pool) { _p = _pool.pop(); }
+
+  explicit TypedPoolGuard(P *pool) : _pool(*pool) { _p = _pool.pop(); }
+
+  ~TypedPoolGuard() { _pool.push(_p); }
+
+  T *operator->() const {
+    assert(_p);
+    return _p;
+  }
+  T &operator*() const {
+    assert(_p);
+    return *_p;
+  }
+
+  explicit operator bool() const { return _p != NULL; }
+
+  T *get() const { return _p; }
+
+  /**
+   * release the element, it will not be pushed back to the pool
+   *
+   * @return  a pointer to the element.
+   */
+  T *release() {
+    T *p = _p;
+    _p = NULL;
+    return p;
+  }
+
+private:
+  P &_pool;
+  T *_p;
+  DISALLOW_COPY_AND_ASSIGN(TypedPoolGuard);
+};
+
+} // namespace co
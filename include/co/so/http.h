@@ -344,6 +344,8 @@ public:
    *   - It will not block the calling thread.
    *
    * @param ip    server ip, either an ipv4 or ipv6 address, default: "0.0.0.0".
+   *              It can also be a unix domain socket like "unix:/path", see
+   *              tcp::Server::start() for details.
    * @param port  server port, default: 80.
    */
   void start(const char *ip = "0.0.0.0", int port = 80);
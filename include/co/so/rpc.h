@@ -2,6 +2,7 @@
 
 #include "../json.h"
 #include "../hash.h"
+#include "tcp.h"
 #include <unordered_map>
 
 namespace rpc {
@@ -71,6 +72,19 @@ private:
 class __codec Client {
 public:
   Client(const char *ip, int port, bool use_ssl = false);
+
+  /**
+   * take connections from a tcp::ConnPool
+   *   - A connection is popped from the pool for each call, and pushed back
+   *     when the call is done, so clients in different coroutines can share
+   *     connections of the pool.
+   *   - Connections of the pool are shared by all clients, set username and
+   *     password on the pool with rpc::set_userpass(pool, ...) when it is
+   *     created, Client::set_userpass() is ignored for such a client.
+   *   - The pool MUST outlive the client.
+   */
+  Client(tcp::ConnPool &pool, const char *ip, int port);
+
   Client(const Client &c);
   ~Client();
 
@@ -79,6 +93,7 @@ public:
   /**
    * set a pair of username and password to logon to the server
    *   - Empty username or password will be ignored.
+   *   - It is ignored for a client using a tcp::ConnPool.
    */
   void set_userpass(const char *user, const char *pass);
 
@@ -94,6 +109,7 @@ public:
 
   /**
    * close the connection
+   *   - It does nothing for a client using a tcp::ConnPool.
    */
   void close();
 
@@ -101,4 +117,15 @@ private:
   void *_p;
 };
 
+/**
+ * set a pair of username and password on a tcp::ConnPool for rpc clients
+ *   - New connections of the pool logon to the server with them, see
+ *     tcp::ConnPool::on_connect(). The pool SHOULD be used only for the same
+ *     server then.
+ *   - It MUST be called before the pool is used.
+ *   - Empty username or password will be ignored.
+ */
+__codec void set_userpass(tcp::ConnPool &pool, const char *user,
+                          const char *pass);
+
 } // namespace rpc
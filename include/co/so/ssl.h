@@ -6,6 +6,7 @@ namespace ssl {
 
 typedef void S; // SSL
 typedef void C; // SSL_CTX
+typedef void Session; // SSL_SESSION
 
 /**
  * get ssl error message
@@ -122,6 +123,104 @@ __codec int use_certificate_file(C *c, const char *path);
  */
 __codec int check_private_key(const C *c);
 
+/**
+ * set the server-side session cache of a SSL_CTX
+ *   - Clients can resume a session in the cache by the session id, which
+ *     saves the public key operations of a full handshake.
+ *
+ * @param c        a pointer to SSL_CTX.
+ * @param size     max sessions in the cache, 0 to disable the cache.
+ * @param timeout  lifetime of a session in seconds, it also applies to
+ *                 session tickets.
+ *
+ * @return         1 on success, otherwise failed.
+ */
+__codec int set_session_cache(C *c, int size, int timeout);
+
+/**
+ * enable session tickets with rotating keys on a server-side SSL_CTX
+ *   - Sessions are encrypted into tickets kept by clients, so they can be
+ *     resumed without a server-side cache.
+ *   - A new key is generated every `rotate` seconds to encrypt new tickets.
+ *     Old keys are kept to decrypt tickets until they expire (the timeout set
+ *     by set_session_cache()), and a client resuming with an old key gets a
+ *     new ticket.
+ *
+ * @param c       a pointer to SSL_CTX.
+ * @param rotate  seconds between key rotations, 0 to disable session tickets.
+ *
+ * @return        1 on success, otherwise failed.
+ */
+__codec int enable_session_tickets(C *c, int rotate);
+
+/**
+ * get the session of a connection for resumption
+ *   - The session is kept valid after the SSL is freed, so it MUST be called
+ *     only before the connection is closed.
+ *   - The result MUST be freed with free_session().
+ *
+ * @param s  a pointer to SSL.
+ *
+ * @return   a pointer to SSL_SESSION, or NULL if the session can't be resumed.
+ */
+__codec Session *get_session(S *s);
+
+/**
+ * wrapper for SSL_set_session
+ *   - Set a session to be resumed, before ssl::connect() is called.
+ *
+ * @param s  a pointer to SSL.
+ * @param x  a pointer to SSL_SESSION, SSL holds its own reference to it.
+ *
+ * @return   1 on success, 0 on error.
+ */
+__codec int set_session(S *s, Session *x);
+
+/**
+ * wrapper for SSL_SESSION_free
+ *
+ * @param x  a pointer to SSL_SESSION.
+ */
+__codec void free_session(Session *x);
+
+/**
+ * wrapper for SSL_session_reused
+ *
+ * @param s  a pointer to SSL.
+ *
+ * @return   true if a session was resumed in the handshake.
+ */
+__codec bool session_reused(const S *s);
+
+/**
+ * enable kernel TLS (kTLS) on a SSL_CTX
+ *   - After a handshake, records are encrypted or decrypted by the kernel if
+ *     it supports the cipher. Otherwise it is done by openssl as usual.
+ *   - It requires openssl 3.0+ built with kTLS support, and the tls module of
+ *     the linux kernel.
+ *
+ * @param c  a pointer to SSL_CTX.
+ *
+ * @return   1 on success, 0 if kTLS is not supported by openssl.
+ */
+__codec int enable_ktls(C *c);
+
+/**
+ * check whether records sent on a SSL are encrypted by the kernel
+ *   - If true, plaintext can be written to the socket directly, by co::send,
+ *     co::sendv or co::sendfile, after the handshake.
+ *
+ * @param s  a pointer to SSL.
+ */
+__codec bool ktls_send(S *s);
+
+/**
+ * check whether records received on a SSL are decrypted by the kernel
+ *
+ * @param s  a pointer to SSL.
+ */
+__codec bool ktls_recv(S *s);
+
 /**
  * shutdown a ssl connection
  *   - It MUST be called in the coroutine that performed the I/O operation.
@@ -156,6 +255,24 @@ __codec int shutdown(S *s, int ms = 3000);
  */
 __codec int accept(S *s, int ms = -1);
 
+/**
+ * run one step of the server side handshake without waiting for IO
+ *   - It can be called in any thread, but not in different threads at the
+ *     same time on a SSL. The CPU-heavy part of a handshake can be done in a
+ *     thread out of the schedulers this way.
+ *   - If the handshake has to wait for IO, *ev is set to co::ev_read or
+ *     co::ev_write, and the handshake should go on when the socket is ready.
+ *     Otherwise *ev is set to 0.
+ *
+ * @param s   a pointer to SSL.
+ * @param ev  a pointer to the IO event to wait for.
+ *
+ * @return    1 on success, a TLS/SSL connection has been established.
+ *          <=0 if the handshake is not complete or on any error, call
+ *            ssl::strerror() in the same thread to get the error message.
+ */
+__codec int try_accept(S *s, int *ev);
+
 /**
  * initiate the handshake with a TLS/SSL server
  *   - It MUST be called in the coroutine that performed the I/O operation.
@@ -217,6 +334,18 @@ __codec int recvn(S *s, void *buf, int n, int ms = -1);
  */
 __codec int send(S *s, const void *buf, int n, int ms = -1);
 
+/**
+ * check whether an idle TLS/SSL connection is still usable
+ *   - It does not block. Records of the TLS protocol received on the idle
+ *     connection, e.g. session tickets of TLS 1.3, are processed by openssl.
+ *
+ * @param s  a pointer to SSL.
+ *
+ * @return   true if there is nothing to read, false on EOF, error, or
+ *           application data not expected on an idle connection.
+ */
+__codec bool alive(S *s);
+
 /**
  * check whether a previous API call has timed out
  *   - When an API with a timeout like ssl::recv returns, ssl::timeout() can be
@@ -1,10 +1,28 @@
 #pragma once
 
 #include "../def.h"
+#include "../co/sock.h"
 #include <functional>
+#include <string.h>
 
 namespace tcp {
 
+/**
+ * traffic counters of a connection
+ *   - They are kept only if FLG_tcp_conn_stats is true, otherwise they are
+ *     all zero.
+ *   - recv_us and send_us are the time spent in recv and send calls, which
+ *     is mostly the time blocked waiting for the peer or the network.
+ */
+struct ConnStats {
+  uint64 bytes_in;   // bytes received
+  uint64 bytes_out;  // bytes sent
+  uint64 recv_calls; // calls of recv, recvn, recvv and splice
+  uint64 send_calls; // calls of send, sendv and sendfile
+  uint64 recv_us;    // microseconds spent in recv calls
+  uint64 send_us;    // microseconds spent in send calls
+};
+
 /**
  * TCP connection for tcp::Server
  *   - An object of tcp::Connection will be created by tcp::Server if a
@@ -46,11 +64,57 @@ struct __codec Connection final {
   /**
    * send n bytes using co::send or ssl::send
    *   - If use SSL, this method may return 0 on error.
+   *   - If FLG_tcp_zerocopy_min > 0 and n is not less than it, data is sent
+   *     by co::send_zerocopy on a connection without SSL.
+   *   - If records of a SSL connection are sent by kTLS (FLG_ssl_ktls), data
+   *     is sent by co::send, and encrypted in the kernel.
    *
    * @return  n on success, <=0 on timeout or error.
    */
   int send(const void *buf, int n, int ms = -1);
 
+  /**
+   * recv into multiple buffers using co::recvv
+   *   - If use SSL, data is received by ssl::recv into the first buffer that
+   *     is not empty.
+   *
+   * @return  >0 on success, -1 on timeout or error, 0 will be returned if the
+   *          peer closed the connection.
+   */
+  int recvv(const co::iovec *iov, int n, int ms = -1);
+
+  /**
+   * send data in multiple buffers using co::sendv
+   *   - If use SSL, small buffers are copied together, and sent by ssl::send
+   *     in one go, unless records are sent by kTLS.
+   *
+   * @return  total size of the buffers on success, <=0 on timeout or error.
+   */
+  int sendv(const co::iovec *iov, int n, int ms = -1);
+
+#ifndef _WIN32
+  /**
+   * send data of a file using co::sendfile
+   *   - If use SSL, data is read to a buffer and sent by ssl::send, unless
+   *     records are sent by kTLS, then file data never enters user space.
+   *
+   * @return  bytes sent on success, which is less than n only if the end of
+   *          the file was reached, or -1 on timeout or error.
+   */
+  int64 sendfile(int file_fd, int64 off, int64 n, int ms = -1);
+
+  /**
+   * move data received on this connection to another socket using co::splice
+   *   - If use SSL, data is received by ssl::recv and sent by co::send.
+   *
+   * @param sock  a non-blocking TCP socket without SSL.
+   *
+   * @return      bytes moved on success, which is less than n only if the peer
+   *              closed the connection, or -1 on timeout or error.
+   */
+  int64 splice(int sock, int64 n, int ms = -1);
+#endif
+
   /**
    * close the connection
    *   - Once a Connection was closed, it can't be used any more.
@@ -75,7 +139,14 @@ struct __codec Connection final {
    */
   const char *strerror() const;
 
+  /**
+   * get traffic counters of the connection
+   *   - It SHOULD be called in the coroutine using the connection.
+   */
+  ConnStats stats() const;
+
 private:
+  friend class ServerImpl;
   void *_p;
 
   DISALLOW_COPY_AND_ASSIGN(Connection);
@@ -89,6 +160,14 @@ private:
  */
 class __codec Server final {
 public:
+  // live counters of a server
+  struct Stats {
+    uint32 active;     // connections being served
+    uint64 rejected;   // connections reset as the server was overloaded
+    uint64 total;      // connections accepted and served
+    ConnStats traffic; // sum of all connections, see FLG_tcp_conn_stats
+  };
+
   Server();
   ~Server();
 
@@ -116,9 +195,42 @@ public:
    *   - The user MUST call on_connection() to set a connection callback before
    * start() was called.
    *   - By default, key and ca are NULL, and ssl is disabled.
+   *   - If FLG_tcp_reuseport is true, each scheduler listens on the port with
+   *     a SO_REUSEPORT socket, and connections will be served in the scheduler
+   *     that accepted them.
+   *   - If FLG_tcp_incoming_cpu is true, a connection will be served in the
+   *     scheduler matching the CPU that handled it (SO_INCOMING_CPU, linux
+   *     only). It is ignored in SO_REUSEPORT mode.
+   *   - FLG_tcp_max_conns and FLG_tcp_max_accept_rate limit the concurrent
+   *     connections and the accept rate. When a limit is reached, the server
+   *     resets new connections, delays accepting, or closes the listening
+   *     socket for a while, according to FLG_tcp_overload. A connection
+   *     is counted as active until the connection callback returns.
+   *   - If FLG_tcp_fastopen > 0, the server accepts data in the SYN from TCP
+   *     Fast Open clients, see Client::connect(ms, buf, n). On linux, TFO
+   *     for servers MUST also be enabled by net.ipv4.tcp_fastopen (bit 2).
+   *   - If FLG_tcp_defer_accept > 0, the kernel holds a new connection until
+   *     data arrives, or for FLG_tcp_defer_accept seconds (linux only), so
+   *     the connection callback starts with a request ready to be read.
+   *   - With ssl, clients can resume sessions instead of full handshakes. The
+   *     server caches up to FLG_ssl_session_cache sessions, and issues session
+   *     tickets encrypted with keys rotated every FLG_ssl_ticket_rotate
+   *     seconds. Both expire after FLG_ssl_session_timeout seconds.
+   *   - If FLG_ssl_handshake_threads > 0, the CPU-heavy steps of ssl handshakes
+   *     run in a pool of that many threads shared by ssl servers, while IO
+   *     is still waited in the coroutine of the connection. A burst of new
+   *     connections will not stall established connections then.
+   *   - If FLG_ssl_ktls is true, records are encrypted by kernel TLS after the
+   *     handshake if the kernel and openssl support it, see ssl::enable_ktls().
+   *     Connection::send(), sendv() and sendfile() write plaintext to the
+   *     socket directly then.
    *
    * @param ip    server ip, either an ipv4 or ipv6 address.
    *              if ip is NULL or empty, "0.0.0.0" will be used by default.
+   *              It can also be a unix domain socket, "unix:/path" for a path
+   *              in the file system, or "unix:@name" for a name in the
+   *              abstract namespace (linux only). A socket file left by a
+   *              previous run is removed, and the port is ignored.
    * @param port  server port.
    * @param key   path of ssl private key file.
    * @param ca    path of ssl certificate file.
@@ -133,6 +245,14 @@ public:
    */
   void exit();
 
+  /**
+   * get live counters of the server
+   *   - It can be called anywhere.
+   *   - If FLG_tcp_conn_stats is true, traffic is updated on every IO call of
+   *     the connections, otherwise it is all zero.
+   */
+  Stats stats() const;
+
 private:
   void *_p;
 
@@ -149,8 +269,12 @@ private:
  *   - It is NOT coroutine-safe, DO NOT use a same Client in different
  * coroutines at the same time.
  *
- *   - It is recommended to put tcp::Client in co::Pool, when lots of
- * connections may be established.
+ *   - It is recommended to use tcp::ConnPool, when lots of connections may be
+ * established.
+ *
+ *   - SSL clients share a SSL_CTX. If FLG_ssl_session_reuse is true, the last
+ *     session with a server is saved when a client disconnects, and the next
+ *     client connecting to the same ip:port resumes it.
  */
 class __codec Client final {
 public:
@@ -159,7 +283,9 @@ public:
    *   - NOTE: It will not connect to the server immediately here.
    *
    * @param ip       a domain name, or either an ipv4 or ipv6 address of the
-   * server. if ip is NULL or empty, "127.0.0.1" will be used by default.
+   * server. if ip is NULL or empty, "127.0.0.1" will be used by default. It
+   * can also be a unix domain socket like "unix:/path" or "unix:@name", see
+   * Server::start() for details, and the port is ignored then.
    * @param port     the server port.
    * @param use_ssl  use ssl if it is true.
    */
@@ -198,11 +324,34 @@ public:
   /**
    * send n bytes using co::send or ssl::send
    *   - If use SSL, this method may return 0 on error.
+   *   - If FLG_tcp_zerocopy_min > 0 and n is not less than it, data is sent
+   *     by co::send_zerocopy on a connection without SSL.
+   *   - If records of a SSL connection are sent by kTLS (FLG_ssl_ktls), data
+   *     is sent by co::send, and encrypted in the kernel.
    *
    * @return  n on success, <=0 on timeout or error.
    */
   int send(const void *buf, int n, int ms = -1);
 
+  /**
+   * recv into multiple buffers using co::recvv
+   *   - If use SSL, data is received by ssl::recv into the first buffer that
+   *     is not empty.
+   *
+   * @return  >0 on success, -1 on timeout or error, 0 will be returned if the
+   *          peer closed the connection.
+   */
+  int recvv(const co::iovec *iov, int n, int ms = -1);
+
+  /**
+   * send data in multiple buffers using co::sendv
+   *   - If use SSL, small buffers are copied together, and sent by ssl::send
+   *     in one go.
+   *
+   * @return  total size of the buffers on success, <=0 on timeout or error.
+   */
+  int sendv(const co::iovec *iov, int n, int ms = -1);
+
   /**
    * check whether the connection has been established
    */
@@ -218,6 +367,21 @@ public:
    */
   bool connect(int ms);
 
+  /**
+   * connect to the server and send the first request
+   *   - Without SSL, data is sent with the SYN by TCP Fast Open if possible,
+   *     which saves a round trip for short-lived connections. See
+   *     co::connect_fastopen() for details. With SSL, data is sent after the
+   *     handshake.
+   *   - If the client has been connected, data is simply sent.
+   *
+   * @param ms  timeout in milliseconds, -1 for never timeout.
+   *
+   * @return    true if connected and n bytes were sent, false on timeout or
+   *            error.
+   */
+  bool connect(int ms, const void *buf, int n);
+
   /**
    * close the connection
    *   - It can be called anywhere since v2.0.1.
@@ -233,15 +397,266 @@ public:
   // get the socket fd
   int socket() const { return _fd; }
 
+  // get traffic counters of the client, see FLG_tcp_conn_stats
+  ConnStats stats() const;
+
 private:
+  friend class ConnPoolImpl;
   union {
     char *_ip; // server ip
-    void **_s; // _s[-1] for (void*)ssl, _s[-2] for (void*)ssl_ctx
+    void **_s; // _s[-1] for (void*)ssl
   };
   uint16 _port;
   uint8 _use_ssl;
   uint8 _;
   int _fd;
+  ConnStats *_st; // NULL if FLG_tcp_conn_stats is false
+};
+
+/**
+ * buffered reader for tcp::Connection or tcp::Client
+ *   - It receives data in large chunks, and serves protocol parsers from its
+ *     buffer, so a parser needs fewer syscalls, and data already scanned for
+ *     a delimiter will not be scanned again.
+ *   - read_until(), read_line(), read_exact() and peek() return views into
+ *     the buffer. data() points to the data, and it is valid until the next
+ *     call of a read method, or release().
+ *   - The buffer is allocated when the first byte arrives, and release()
+ *     frees it if no data is buffered, so idle connections need not hold it.
+ *   - It does not own the connection, the connection MUST outlive it.
+ *
+ *   - usage:
+ *     tcp::Reader r(conn);
+ *     int n = r.read_until("\r\n\r\n", 8192, 3000);
+ *     if (n > 0) parse_header(r.data(), r.size());
+ */
+class __codec Reader {
+public:
+  /**
+   * @param cap  initial capacity of the buffer, it grows as needed.
+   */
+  explicit Reader(Connection &conn, size_t cap = 4096);
+  explicit Reader(Client &cli, size_t cap = 4096);
+
+  ~Reader();
+
+  Reader(const Reader &) = delete;
+  void operator=(const Reader &) = delete;
+
+  /**
+   * read until a delimiter was found
+   *   - The result includes the delimiter.
+   *   - If the delimiter is not found within max bytes, it returns -1, and
+   *     co::error() will be EMSGSIZE.
+   *
+   * @param delim  the delimiter.
+   * @param n      size of the delimiter.
+   * @param max    max bytes to read.
+   * @param ms     timeout in milliseconds for each recv, -1 for never timeout.
+   *
+   * @return       size of the result on success, -1 on timeout or error, 0
+   *               will be returned if the peer closed the connection.
+   */
+  int read_until(const char *delim, size_t n, size_t max, int ms = -1);
+
+  int read_until(const char *delim, size_t max, int ms = -1) {
+    return this->read_until(delim, strlen(delim), max, ms);
+  }
+
+  int read_until(char delim, size_t max, int ms = -1) {
+    return this->read_until(&delim, 1, max, ms);
+  }
+
+  /**
+   * read a line ends with "\n" or "\r\n"
+   *   - size() is the length of the line without the line ending.
+   *
+   * @return  bytes read including the line ending on success, -1 on timeout
+   *          or error, 0 will be returned if the peer closed the connection.
+   */
+  int read_line(size_t max, int ms = -1);
+
+  /**
+   * read exactly n bytes
+   *
+   * @return  n on success, -1 on timeout or error, 0 will be returned if the
+   *          peer closed the connection.
+   */
+  int read_exact(size_t n, int ms = -1);
+
+  /**
+   * read exactly n bytes into a buffer provided by the user
+   *   - Data in the buffer of the reader is copied first, the rest is
+   *     received into buf directly if it is large.
+   *
+   * @return  n on success, -1 on timeout or error, 0 will be returned if the
+   *          peer closed the connection.
+   */
+  int read_exact(void *buf, size_t n, int ms = -1);
+
+  /**
+   * wait until at least n bytes are buffered, without consuming them
+   *   - The view is all data buffered.
+   *
+   * @return  bytes buffered on success, which is not less than n, -1 on
+   *          timeout or error, 0 will be returned if the peer closed the
+   *          connection.
+   */
+  int peek(size_t n, int ms = -1);
+
+  // data of the last read
+  const char *data() const { return _buf + _v; }
+
+  // size of the last read
+  size_t size() const { return _vn; }
+
+  // bytes buffered but not read yet
+  size_t buffered() const { return _w - _r; }
+
+  // free the buffer if no data is buffered
+  void release();
+
+private:
+  int recv(void *buf, int n, int ms);
+  int recvn(void *buf, int n, int ms);
+  int fill(size_t need, int ms);
+
+  void *_c; // Connection or Client
+  bool _client;
+  char *_buf;
+  size_t _init_cap;
+  size_t _cap;
+  size_t _r;  // read position
+  size_t _w;  // write position
+  size_t _v;  // beginning of the view
+  size_t _vn; // size of the view
+};
+
+/**
+ * connection pool for tcp::Client, keyed by host:port
+ *   - Each scheduler holds its own idle connections, pop() and push() MUST be
+ *     called in a coroutine, and a connection SHOULD be pushed back in the
+ *     scheduler where it was popped.
+ *   - max_conns limits connections of a host checked out at the same time.
+ *     When the limit is reached, pop() waits for a connection to be pushed
+ *     back to the pool.
+ *   - An idle connection is checked with a non-blocking peek before it is
+ *     handed out. It is dropped if the peer has closed it, or if there is
+ *     unexpected data on it.
+ *   - Connections idle for more than idle_ms are closed in the background.
+ *   - It is not copyable, share it by reference or pointer.
+ *
+ *   - usage:
+ *     tcp::ConnPool pool(64);
+ *     pool.warm_up("127.0.0.1", 7788, 4);
+ *
+ *     tcp::ConnGuard c(pool, "127.0.0.1", 7788, 3000);
+ *     if (c) c->send(buf, n, 3000);
+ */
+class __codec ConnPool {
+public:
+  struct Stats {
+    uint64 hit;     // pop() got an idle connection
+    uint64 miss;    // pop() created a new connection
+    uint64 dead;    // idle connections dropped by the check in pop()
+    uint64 evicted; // idle connections closed for idle timeout
+    uint64 failed;  // pop() failed to connect, or timed out on the limit
+    uint32 busy;    // connections checked out now
+    uint32 idle;    // idle connections now
+  };
+
+  /**
+   * @param max_conns  max connections checked out for each host, 0 for
+   *                   unlimited. default: 0.
+   * @param max_idle   max idle connections for each host in each scheduler.
+   *                   default: 64.
+   * @param idle_ms    idle connections will be closed after idle_ms
+   *                   milliseconds, 0 for never. default: 60000.
+   * @param use_ssl    use ssl for connections. default: false.
+   */
+  explicit ConnPool(uint32 max_conns = 0, uint32 max_idle = 64,
+                    uint32 idle_ms = 60000, bool use_ssl = false);
+
+  /**
+   * close all idle connections
+   *   - Connections checked out MUST have been pushed back.
+   */
+  ~ConnPool();
+
+  ConnPool(const ConnPool &) = delete;
+  void operator=(const ConnPool &) = delete;
+
+  /**
+   * set a callback for new connections
+   *   - It is called after a connection was established, e.g. to log on to
+   *     the server. The connection will be dropped if it returns false.
+   *   - It MUST be set before the pool is used.
+   */
+  void on_connect(std::function<bool(Client &)> &&f);
+
+  /**
+   * check out a connection to host:port
+   *   - It MUST be called in a coroutine.
+   *   - An idle connection of the current scheduler is used first, or a new
+   *     connection will be established.
+   *
+   * @param ms  timeout in milliseconds for waiting on the limit, and for
+   *            connecting, -1 for never timeout. default: -1.
+   *
+   * @return    a connected client, or NULL on timeout or error.
+   */
+  Client *pop(const char *host, int port, int ms = -1);
+
+  /**
+   * check in a connection
+   *   - It MUST be called in a coroutine.
+   *   - The connection MUST be popped from this pool. If it was disconnected,
+   *     e.g. on error, it will be destroyed instead.
+   */
+  void push(Client *c);
+
+  /**
+   * establish n idle connections to host:port in each scheduler
+   *   - It returns at once, connections are established in the background.
+   *
+   * @param ms  timeout in milliseconds for connecting. default: 3000.
+   */
+  void warm_up(const char *host, int port, uint32 n, int ms = 3000);
+
+  // counters added up from all hosts and schedulers
+  Stats stats() const;
+
+private:
+  void *_p;
+};
+
+/**
+ * guard to push a connection back to tcp::ConnPool
+ *   - ConnPool::pop() is called in the constructor, check it with operator
+ *     bool before use.
+ *   - ConnPool::push() is called in the destructor.
+ */
+class __codec ConnGuard {
+public:
+  ConnGuard(ConnPool &pool, const char *host, int port, int ms = -1)
+      : _pool(pool), _c(pool.pop(host, port, ms)) {}
+
+  ~ConnGuard() {
+    if (_c)
+      _pool.push(_c);
+  }
+
+  ConnGuard(const ConnGuard &) = delete;
+  void operator=(const ConnGuard &) = delete;
+
+  Client *operator->() const { return _c; }
+  Client &operator*() const { return *_c; }
+  explicit operator bool() const { return _c != 0; }
+  Client *get() const { return _c; }
+
+private:
+  ConnPool &_pool;
+  Client *_c;
 };
 
 } // namespace tcp
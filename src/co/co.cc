@@ -1,7 +1,7 @@
 #include "scheduler.h"
+#include <atomic>
 #include <deque>
 #include <new>
-#include <unordered_set>
 
 namespace co {
 
@@ -20,8 +20,7 @@ public:
 private:
   ::Mutex _mtx;
   co::xx::cond_t _cond;
-  std::unordered_set<Coroutine *> _co_wait;
-  std::unordered_set<Coroutine *> _co_swap;
+  CoList _co_wait;
   uint32 _counter;
   bool _signaled;
   bool _has_cond;
@@ -41,7 +40,7 @@ bool EventImpl::wait(uint32 ms) {
         return true;
       }
       co->state = st_wait;
-      _co_wait.insert(co);
+      _co_wait.push_back(co);
     }
 
     if (ms != (uint32)-1)
@@ -49,7 +48,8 @@ bool EventImpl::wait(uint32 ms) {
     s->yield();
     if (s->timeout()) {
       ::MutexGuard g(_mtx);
-      _co_wait.erase(co);
+      if (_co_wait.contains(co))
+        _co_wait.erase(co);
     }
 
     co->state = st_init;
@@ -81,10 +81,16 @@ bool EventImpl::wait(uint32 ms) {
 }
 
 void EventImpl::signal() {
+  CoList l;
   {
     ::MutexGuard g(_mtx);
-    if (!_co_wait.empty())
-      _co_wait.swap(_co_swap);
+    // Using atomic operation here, as check_timeout() in the Scheduler
+    // may also modify the state. The list must be drained under the lock,
+    // as a coroutine timed out checks whether it is still in the list.
+    for (Coroutine *co; (co = _co_wait.pop_front());) {
+      if (atomic_compare_swap(&co->state, st_wait, st_ready) == st_wait)
+        l.push_back(co);
+    }
     if (!_signaled) {
       _signaled = true;
       if (_counter > 0) {
@@ -95,19 +101,11 @@ void EventImpl::signal() {
         co::xx::cond_notify(&_cond);
       }
     }
-    if (_co_swap.empty())
-      return;
   }
 
-  // Using atomic operation here, as check_timeout() in the Scheduler
-  // may also modify the state.
-  for (auto it = _co_swap.begin(); it != _co_swap.end(); ++it) {
-    Coroutine *co = *it;
-    if (atomic_compare_swap(&co->state, st_wait, st_ready) == st_wait) {
-      ((SchedulerImpl *)co->s)->add_ready_task(co);
-    }
-  }
-  _co_swap.clear();
+  // wake up the coroutines in batches, one per scheduler
+  if (!l.empty())
+    co::ready(l, gSched);
 }
 
 // memory: |4(refn)|4|EventImpl|
@@ -153,56 +151,135 @@ void WaitGroup::done() const {
 
 void WaitGroup::wait() const { ((EventImpl *)(_p + 2))->wait((uint32)-1); }
 
+/**
+ * MutexImpl is an adaptive lock for coroutines
+ *   - The lock state is kept in an atomic word, lock() and unlock() without
+ *     contention need only one CAS operation.
+ *   - On contention, lock() spins for a while if the lock is held by another
+ *     scheduler, and then parks the coroutine in an intrusive waiter list.
+ *   - A woken coroutine competes for the lock with newcomers. If it has waited
+ *     for more than kStarveUs, the mutex turns into handoff mode, unlock() then
+ *     passes the lock to the first waiter directly, newcomers can't barge in.
+ *     The mutex leaves handoff mode when the waiter list becomes empty.
+ */
 class MutexImpl {
 public:
-  MutexImpl() : _lock(false) {}
+  enum {
+    kLocked = 1,
+    kHandoff = 2,
+    kWaiter = 4, // waiter count is stored in the higher bits
+  };
+  static const int kSpin = 64;
+  static const int64 kStarveUs = 1000;
+
+  MutexImpl() : _state(0), _owner(0), _handoff(0) {}
   ~MutexImpl() = default;
 
-  void lock();
+  void lock() {
+    auto s = gSched;
+    CHECK(s) << "must be called in coroutine..";
+    if (atomic_compare_swap(&_state, 0, kLocked) != 0)
+      this->lock_slow(s);
+    _owner.store(s, std::memory_order_relaxed);
+  }
 
-  void unlock();
+  void unlock() {
+    if (atomic_compare_swap(&_state, kLocked, 0) != kLocked)
+      this->unlock_slow();
+  }
 
-  bool try_lock();
+  bool try_lock() {
+    const uint32 x = atomic_get(&_state);
+    if ((x & (kLocked | kHandoff)) == 0 &&
+        atomic_compare_swap(&_state, x, x | kLocked) == x) {
+      _owner.store(gSched, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
 
 private:
   ::Mutex _mtx;
-  std::deque<Coroutine *> _co_wait;
-  bool _lock;
+  CoList _co_wait;
+  uint32 _state;
+  // the scheduler holds the lock, a hint for spinning. It is read by other
+  // schedulers without the lock, relaxed order is enough for a hint.
+  std::atomic<SchedulerImpl *> _owner;
+  Coroutine *_handoff; // the coroutine the lock was handed over to
+
+  void lock_slow(SchedulerImpl *s);
+  void unlock_slow();
 };
 
-inline bool MutexImpl::try_lock() {
-  ::MutexGuard g(_mtx);
-  return _lock ? false : (_lock = true);
-}
+void MutexImpl::lock_slow(SchedulerImpl *s) {
+  // It makes no sense to spin if the lock is held by the current scheduler.
+  if (_owner.load(std::memory_order_relaxed) != s) {
+    for (int i = 0; i < kSpin; ++i) {
+      const uint32 x = atomic_get(&_state);
+      if ((x & (kLocked | kHandoff)) == 0 &&
+          atomic_compare_swap(&_state, x, x | kLocked) == x) {
+        return;
+      }
+      co::cpu_relax();
+    }
+  }
 
-inline void MutexImpl::lock() {
-  auto s = gSched;
-  CHECK(s) << "must be called in coroutine..";
-  _mtx.lock();
-  if (!_lock) {
-    _lock = true;
-    _mtx.unlock();
-  } else {
-    Coroutine *co = s->running();
-    if (co->s != s)
-      co->s = s;
-    _co_wait.push_back(co);
+  Coroutine *co = s->running();
+  if (co->s != s)
+    co->s = s;
+  int64 beg = 0;
+
+  while (true) {
+    _mtx.lock();
+    const uint32 x = atomic_get(&_state);
+    if ((x & (kLocked | kHandoff)) == 0) {
+      const bool ok = atomic_compare_swap(&_state, x, x | kLocked) == x;
+      _mtx.unlock();
+      if (ok)
+        return;
+      continue;
+    }
+
+    // The waiter count MUST be updated before unlock() checks the state,
+    // otherwise unlock() may take the fast path and the waiter is lost.
+    uint32 v = x + kWaiter;
+    if (beg != 0 && !(x & kHandoff) && now::us() - beg > kStarveUs)
+      v |= kHandoff;
+    if (atomic_compare_swap(&_state, x, v) != x) {
+      _mtx.unlock();
+      continue;
+    }
+
+    // a woken coroutine that failed to get the lock goes to the front
+    beg == 0 ? _co_wait.push_back(co) : _co_wait.push_front(co);
     _mtx.unlock();
+    if (beg == 0)
+      beg = now::us();
+
     s->yield();
+    if (_handoff == co) {
+      _handoff = 0;
+      return;
+    }
   }
 }
 
-inline void MutexImpl::unlock() {
-  _mtx.lock();
-  if (_co_wait.empty()) {
-    _lock = false;
-    _mtx.unlock();
-  } else {
-    Coroutine *co = _co_wait.front();
-    _co_wait.pop_front();
-    _mtx.unlock();
-    ((SchedulerImpl *)co->s)->add_ready_task(co);
+void MutexImpl::unlock_slow() {
+  Coroutine *co;
+  {
+    ::MutexGuard g(_mtx);
+    co = _co_wait.pop_front();
+    CHECK(co != NULL) << "co::Mutex unlock error..";
+    const uint32 x = atomic_get(&_state);
+    if (x & kHandoff) {
+      // keep the lock locked and pass it to the waiter
+      _handoff = co;
+      atomic_sub(&_state, _co_wait.empty() ? kWaiter + kHandoff : kWaiter);
+    } else {
+      atomic_sub(&_state, kWaiter + kLocked);
+    }
   }
+  co::ready(co, gSched);
 }
 
 // memory: |4(refn)|4|MutexImpl|
@@ -225,18 +302,384 @@ void Mutex::unlock() const { ((MutexImpl *)(_p + 2))->unlock(); }
 
 bool Mutex::try_lock() const { return ((MutexImpl *)(_p + 2))->try_lock(); }
 
+/**
+ * SemaphoreImpl
+ *   - Waiters are served in FIFO order. A waiter at the head of the list
+ *     blocks the ones behind it until its request can be satisfied, so that
+ *     a large request will not be starved by small ones.
+ *   - Resources released are passed to waiters directly under the lock, and
+ *     waiters woken up are resumed in batches grouped by scheduler.
+ *   - A waiter may time out while a releaser is popping it from the list. The
+ *     state of the coroutine decides who wins: the releaser passes resources
+ *     to the waiter only if it changes the state from st_wait to st_ready.
+ */
+class SemaphoreImpl {
+public:
+  explicit SemaphoreImpl(uint32 n = 0) : _count(n) {}
+  ~SemaphoreImpl() = default;
+
+  bool acquire(uint32 n, uint32 ms);
+
+  bool try_acquire(uint32 n) {
+    ::MutexGuard g(_mtx);
+    if (_co_wait.empty() && _count >= n) {
+      _count -= n;
+      return true;
+    }
+    return false;
+  }
+
+  void release(uint32 n) {
+    CoList l;
+    {
+      ::MutexGuard g(_mtx);
+      _count += n;
+      this->wake_waiters(l);
+    }
+    if (!l.empty())
+      co::ready(l, gSched);
+  }
+
+private:
+  // pop waiters that can be satisfied now to @l, _mtx MUST be locked
+  void wake_waiters(CoList &l) {
+    for (Coroutine *co; (co = _co_wait.front()) && co->wn <= _count;) {
+      _co_wait.pop_front();
+      if (atomic_compare_swap(&co->state, st_wait, st_ready) == st_wait) {
+        _count -= co->wn;
+        l.push_back(co);
+      }
+    }
+  }
+
+  ::Mutex _mtx;
+  CoList _co_wait;
+  uint32 _count;
+};
+
+bool SemaphoreImpl::acquire(uint32 n, uint32 ms) {
+  auto s = gSched;
+  CHECK(s) << "must be called in coroutine..";
+  {
+    ::MutexGuard g(_mtx);
+    if (_co_wait.empty() && _count >= n) {
+      _count -= n;
+      return true;
+    }
+    if (ms == 0)
+      return false;
+
+    Coroutine *co = s->running();
+    if (co->s != s)
+      co->s = s;
+    co->wn = n;
+    co->state = st_wait;
+    _co_wait.push_back(co);
+  }
+
+  if (ms != (uint32)-1)
+    s->add_timer(ms);
+  s->yield();
+
+  Coroutine *co = s->running();
+  if (s->timeout()) {
+    CoList l;
+    {
+      ::MutexGuard g(_mtx);
+      if (_co_wait.contains(co)) {
+        const bool head = _co_wait.front() == co;
+        _co_wait.erase(co);
+        // waiters behind us may be satisfied now
+        if (head)
+          this->wake_waiters(l);
+      }
+    }
+    if (!l.empty())
+      co::ready(l, s);
+  }
+
+  co->state = st_init;
+  return !s->timeout();
+}
+
+/**
+ * CondVarImpl
+ *   - A coroutine is added to the waiter list before it releases the mutex,
+ *     so a notification sent after that will never be lost.
+ *   - notify_all() drains the whole list under the lock and wakes up the
+ *     waiters in batches grouped by scheduler.
+ */
+class CondVarImpl {
+public:
+  CondVarImpl() = default;
+  ~CondVarImpl() = default;
+
+  bool wait(const co::Mutex &m, uint32 ms);
+
+  void notify_one() {
+    Coroutine *co = 0;
+    {
+      ::MutexGuard g(_mtx);
+      while ((co = _co_wait.pop_front())) {
+        if (atomic_compare_swap(&co->state, st_wait, st_ready) == st_wait)
+          break;
+      }
+    }
+    if (co)
+      co::ready(co, gSched);
+  }
+
+  void notify_all() {
+    CoList l;
+    {
+      // A waiter timed out checks whether it is still in _co_wait under the
+      // lock, so the list must be drained under the lock.
+      ::MutexGuard g(_mtx);
+      for (Coroutine *co; (co = _co_wait.pop_front());) {
+        if (atomic_compare_swap(&co->state, st_wait, st_ready) == st_wait)
+          l.push_back(co);
+      }
+    }
+    if (!l.empty())
+      co::ready(l, gSched);
+  }
+
+private:
+  ::Mutex _mtx;
+  CoList _co_wait;
+};
+
+bool CondVarImpl::wait(const co::Mutex &m, uint32 ms) {
+  auto s = gSched;
+  CHECK(s) << "must be called in coroutine..";
+  Coroutine *co = s->running();
+  if (co->s != s)
+    co->s = s;
+  {
+    ::MutexGuard g(_mtx);
+    co->state = st_wait;
+    _co_wait.push_back(co);
+  }
+  m.unlock();
+
+  if (ms != (uint32)-1)
+    s->add_timer(ms);
+  s->yield();
+
+  co = s->running();
+  if (s->timeout()) {
+    ::MutexGuard g(_mtx);
+    if (_co_wait.contains(co))
+      _co_wait.erase(co);
+  }
+
+  co->state = st_init;
+  const bool r = !s->timeout();
+  m.lock();
+  return r;
+}
+
+// memory: |4(refn)|4|SemaphoreImpl|
+Semaphore::Semaphore(uint32 n) {
+  _p = (uint32 *)malloc(sizeof(SemaphoreImpl) + 8);
+  _p[0] = 1; // refn
+  new (_p + 2) SemaphoreImpl(n);
+}
+
+Semaphore::~Semaphore() {
+  if (_p && atomic_dec(_p) == 0) {
+    ((SemaphoreImpl *)(_p + 2))->~SemaphoreImpl();
+    free(_p);
+  }
+}
+
+void Semaphore::acquire() const {
+  ((SemaphoreImpl *)(_p + 2))->acquire(1, (uint32)-1);
+}
+
+bool Semaphore::acquire(uint32 ms) const {
+  return ((SemaphoreImpl *)(_p + 2))->acquire(1, ms);
+}
+
+bool Semaphore::acquire_n(uint32 n, uint32 ms) const {
+  return ((SemaphoreImpl *)(_p + 2))->acquire(n, ms);
+}
+
+bool Semaphore::try_acquire(uint32 n) const {
+  return ((SemaphoreImpl *)(_p + 2))->try_acquire(n);
+}
+
+void Semaphore::release(uint32 n) const {
+  ((SemaphoreImpl *)(_p + 2))->release(n);
+}
+
+// memory: |4(refn)|4|CondVarImpl|
+CondVar::CondVar() {
+  _p = (uint32 *)malloc(sizeof(CondVarImpl) + 8);
+  _p[0] = 1; // refn
+  new (_p + 2) CondVarImpl;
+}
+
+CondVar::~CondVar() {
+  if (_p && atomic_dec(_p) == 0) {
+    ((CondVarImpl *)(_p + 2))->~CondVarImpl();
+    free(_p);
+  }
+}
+
+void CondVar::wait(const co::Mutex &m) const {
+  ((CondVarImpl *)(_p + 2))->wait(m, (uint32)-1);
+}
+
+bool CondVar::wait(const co::Mutex &m, uint32 ms) const {
+  return ((CondVarImpl *)(_p + 2))->wait(m, ms);
+}
+
+void CondVar::notify_one() const { ((CondVarImpl *)(_p + 2))->notify_one(); }
+
+void CondVar::notify_all() const { ((CondVarImpl *)(_p + 2))->notify_all(); }
+
+/**
+ * RWMutexImpl
+ *   - _rcount is the number of readers, it is biased by -kMaxReaders while a
+ *     writer holds the lock or is waiting for it, so readers can take the fast
+ *     path with a single atomic operation when there is no writer.
+ *   - Writers are serialized by _w. A writer waits on _wsem until readers that
+ *     were active when it arrived (counted by _rdepart) are gone, and readers
+ *     that arrived after the writer wait on _rsem.
+ */
+class RWMutexImpl {
+public:
+  static const int32 kMaxReaders = 1 << 30;
+
+  RWMutexImpl() : _rcount(0), _rdepart(0) {}
+  ~RWMutexImpl() = default;
+
+  void rlock() {
+    if (atomic_inc(&_rcount) < 0)
+      _rsem.acquire(1, (uint32)-1); // a writer is pending, wait for it
+  }
+
+  void runlock() {
+    const int32 r = atomic_dec(&_rcount);
+    if (r < 0) {
+      CHECK(r + 1 != 0 && r + 1 != -kMaxReaders) << "co::RWMutex runlock error..";
+      if (atomic_dec(&_rdepart) == 0)
+        _wsem.release(1); // the last reader unblocks the writer
+    }
+  }
+
+  bool try_rlock() {
+    int32 r = atomic_get(&_rcount);
+    while (r >= 0) {
+      const int32 x = atomic_compare_swap(&_rcount, r, r + 1);
+      if (x == r)
+        return true;
+      r = x;
+    }
+    return false;
+  }
+
+  void lock() {
+    _w.lock();
+    const int32 r = atomic_sub(&_rcount, kMaxReaders) + kMaxReaders;
+    if (r != 0 && atomic_add(&_rdepart, r) != 0)
+      _wsem.acquire(1, (uint32)-1);
+  }
+
+  void unlock() {
+    const int32 r = atomic_add(&_rcount, kMaxReaders);
+    CHECK_LT(r, kMaxReaders) << "co::RWMutex unlock error..";
+    if (r > 0)
+      _rsem.release((uint32)r);
+    _w.unlock();
+  }
+
+  bool try_lock() {
+    if (!_w.try_lock())
+      return false;
+    if (atomic_compare_swap(&_rcount, 0, -kMaxReaders) != 0) {
+      _w.unlock();
+      return false;
+    }
+    return true;
+  }
+
+private:
+  MutexImpl _w;
+  SemaphoreImpl _wsem;
+  SemaphoreImpl _rsem;
+  int32 _rcount;
+  int32 _rdepart;
+};
+
+// memory: |4(refn)|4|RWMutexImpl|
+RWMutex::RWMutex() {
+  _p = (uint32 *)malloc(sizeof(RWMutexImpl) + 8);
+  _p[0] = 1; // refn
+  new (_p + 2) RWMutexImpl;
+}
+
+RWMutex::~RWMutex() {
+  if (_p && atomic_dec(_p) == 0) {
+    ((RWMutexImpl *)(_p + 2))->~RWMutexImpl();
+    free(_p);
+  }
+}
+
+void RWMutex::lock() const { ((RWMutexImpl *)(_p + 2))->lock(); }
+
+void RWMutex::unlock() const { ((RWMutexImpl *)(_p + 2))->unlock(); }
+
+bool RWMutex::try_lock() const { return ((RWMutexImpl *)(_p + 2))->try_lock(); }
+
+void RWMutex::rlock() const { ((RWMutexImpl *)(_p + 2))->rlock(); }
+
+void RWMutex::runlock() const { ((RWMutexImpl *)(_p + 2))->runlock(); }
+
+bool RWMutex::try_rlock() const {
+  return ((RWMutexImpl *)(_p + 2))->try_rlock();
+}
+
+/**
+ * PoolImpl
+ *   - Each scheduler has its own pool, which is accessed without any lock.
+ *   - If shared_cap > 0, elements overflowed from a full pool go to a shared
+ *     tier, and a scheduler with an empty pool steals elements from it before
+ *     creating a new one. The shared tier is an array of slots, elements are
+ *     put into and taken from it with CAS, no lock is needed.
+ *   - If idle_ms > 0, a coroutine is created in each scheduler on the first
+ *     push(), to destroy elements that stay idle in the pools for too long.
+ */
 class PoolImpl {
 public:
-  typedef std::vector<void *> V;
+  struct E {
+    void *p;
+    int64 t; // when it was pushed, in milliseconds
+  };
+  typedef std::vector<E> V;
 
-  PoolImpl() : _pools(co::scheduler_num()), _maxcap((size_t)-1) {}
+  PoolImpl()
+      : _pools(co::scheduler_num()), _maxcap((size_t)-1), _shared(0),
+        _shared_cap(0), _shared_num(0), _idle_ms(0), _evicting(0), _ev(0) {}
 
   PoolImpl(std::function<void *()> &&ccb, std::function<void(void *)> &&dcb,
-           size_t cap)
+           size_t cap, size_t shared_cap, uint32 idle_ms)
       : _pools(co::scheduler_num()), _maxcap(cap), _ccb(std::move(ccb)),
-        _dcb(std::move(dcb)) {}
+        _dcb(std::move(dcb)), _shared(0), _shared_cap(shared_cap),
+        _shared_num(0), _idle_ms(_dcb ? idle_ms : 0), _evicting(0), _ev(0) {
+    if (_shared_cap > 0) {
+      _shared = (E *)calloc(_shared_cap, sizeof(E));
+    }
+  }
 
-  ~PoolImpl() { this->clear(); }
+  ~PoolImpl() {
+    this->stop_evicting();
+    this->clear();
+    if (_shared)
+      ::free(_shared);
+    delete _ev;
+  }
 
   void *pop();
 
@@ -251,12 +694,67 @@ private:
   size_t _maxcap;
   std::function<void *()> _ccb;
   std::function<void(void *)> _dcb;
+  E *_shared;         // slots of the shared tier
+  size_t _shared_cap; // number of slots in the shared tier
+  size_t _shared_num; // number of elements in the shared tier (hint)
+  uint32 _idle_ms;    // max idle time of elements, 0 for never evict
+  uint32 _evicting;   // 1 if coroutines for eviction were created
+
+  // created when eviction starts, most pools never evict
+  struct Evictor {
+    co::Semaphore stop;
+    co::WaitGroup wg;
+  };
+  Evictor *_ev;
 
   V *new_pool() {
     V *v = new V();
     v->reserve(1024);
     return v;
   }
+
+  int64 now_ms() const { return _idle_ms ? now::ms() : 0; }
+
+  // Put an element into the shared tier. The timestamp is written before the
+  // CAS, a racing push may overwrite the timestamp of an occupied slot, which
+  // only delays eviction of that element.
+  bool shared_push(void *p, int64 t) {
+    if (atomic_get(&_shared_num) >= _shared_cap)
+      return false;
+    const size_t x = gSched->id() * _shared_cap / _pools.size();
+    for (size_t i = 0; i < _shared_cap; ++i) {
+      E &e = _shared[(x + i) % _shared_cap];
+      if (atomic_get(&e.p) == 0) {
+        atomic_set(&e.t, t);
+        if (atomic_compare_swap(&e.p, (void *)0, p) == 0) {
+          atomic_inc(&_shared_num);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void *shared_pop() {
+    if (atomic_get(&_shared_num) == 0)
+      return 0;
+    const size_t x = gSched->id() * _shared_cap / _pools.size();
+    for (size_t i = 0; i < _shared_cap; ++i) {
+      E &e = _shared[(x + i) % _shared_cap];
+      if (atomic_get(&e.p) != 0) {
+        void *p = atomic_swap(&e.p, (void *)0);
+        if (p) {
+          atomic_dec(&_shared_num);
+          return p;
+        }
+      }
+    }
+    return 0;
+  }
+
+  void start_evicting();
+  void stop_evicting();
+  void evict();
 };
 
 inline void *PoolImpl::pop() {
@@ -265,12 +763,16 @@ inline void *PoolImpl::pop() {
   if (v == NULL)
     v = this->new_pool();
   if (!v->empty()) {
-    void *p = v->back();
+    void *p = v->back().p;
     v->pop_back();
     return p;
-  } else {
-    return _ccb ? _ccb() : 0;
   }
+  if (_shared) {
+    void *p = this->shared_pop();
+    if (p)
+      return p;
+  }
+  return _ccb ? _ccb() : 0;
 }
 
 inline void PoolImpl::push(void *p) {
@@ -280,13 +782,79 @@ inline void PoolImpl::push(void *p) {
   auto &v = _pools[gSched->id()];
   if (v == NULL)
     v = this->new_pool();
-  if (v->size() < _maxcap || !_dcb) {
-    v->push_back(p);
-  } else {
+  if (_idle_ms && !_evicting)
+    this->start_evicting();
+
+  const int64 t = this->now_ms();
+  if (v->size() < _maxcap) {
+    v->push_back({p, t});
+  } else if (_shared && this->shared_push(p, t)) {
+    /* overflowed to the shared tier */
+  } else if (_dcb) {
     _dcb(p);
+  } else {
+    v->push_back({p, t});
   }
 }
 
+// Create a coroutine in each scheduler, which wakes up on the scheduler timer
+// every once in a while, and destroys elements idle for more than _idle_ms.
+void PoolImpl::start_evicting() {
+  if (atomic_compare_swap(&_evicting, 0, 1) != 0)
+    return;
+  const uint32 ms = _idle_ms < 1000 ? _idle_ms : 1000;
+  auto &scheds = co::all_schedulers();
+  Evictor *ev = new Evictor();
+  ev->wg.add((uint32)scheds.size());
+  _ev = ev;
+  for (auto &s : scheds) {
+    s->go([this, ev, ms]() {
+      while (!ev->stop.acquire(ms))
+        this->evict();
+      ev->wg.done();
+    });
+  }
+}
+
+void PoolImpl::stop_evicting() {
+  if (atomic_get(&_evicting) && !co::is_stopped()) {
+    _ev->stop.release((uint32)_pools.size());
+    _ev->wg.wait();
+  }
+}
+
+void PoolImpl::evict() {
+  const int64 deadline = now::ms() - _idle_ms;
+  std::vector<void *> x;
+
+  // elements are pushed to the back, the oldest ones are in the front
+  auto &v = _pools[gSched->id()];
+  if (v != NULL) {
+    size_t n = 0;
+    while (n < v->size() && (*v)[n].t <= deadline)
+      x.push_back((*v)[n++].p);
+    if (n > 0)
+      v->erase(v->begin(), v->begin() + n);
+  }
+
+  // the shared tier is checked by the first scheduler only
+  if (_shared && gSched->id() == 0 && atomic_get(&_shared_num) > 0) {
+    for (size_t i = 0; i < _shared_cap; ++i) {
+      E &e = _shared[i];
+      void *p = atomic_get(&e.p);
+      if (p && atomic_get(&e.t) <= deadline &&
+          atomic_compare_swap(&e.p, p, (void *)0) == p) {
+        atomic_dec(&_shared_num);
+        x.push_back(p);
+      }
+    }
+  }
+
+  // _dcb may yield, elements are destroyed after they are removed
+  for (auto &p : x)
+    _dcb(p);
+}
+
 // Create n coroutines to clear all the pools, n is number of schedulers.
 // clear() blocks untils all the coroutines are done.
 void PoolImpl::clear() {
@@ -301,7 +869,7 @@ void PoolImpl::clear() {
         if (v != NULL) {
           if (this->_dcb)
             for (auto &e : *v)
-              this->_dcb(e);
+              this->_dcb(e.p);
           delete v;
           v = NULL;
         }
@@ -315,12 +883,21 @@ void PoolImpl::clear() {
       if (v != NULL) {
         if (this->_dcb)
           for (auto &e : *v)
-            this->_dcb(e);
+            this->_dcb(e.p);
         delete v;
         v = NULL;
       }
     }
   }
+
+  for (size_t i = 0; i < _shared_cap; ++i) {
+    void *p = atomic_swap(&_shared[i].p, (void *)0);
+    if (p) {
+      atomic_dec(&_shared_num);
+      if (_dcb)
+        _dcb(p);
+    }
+  }
 }
 
 inline size_t PoolImpl::size() const {
@@ -344,10 +921,11 @@ Pool::~Pool() {
 }
 
 Pool::Pool(std::function<void *()> &&ccb, std::function<void(void *)> &&dcb,
-           size_t cap) {
+           size_t cap, size_t shared_cap, uint32 idle_ms) {
   _p = (uint32 *)malloc(sizeof(PoolImpl) + 8);
   _p[0] = 1;
-  new (_p + 2) PoolImpl(std::move(ccb), std::move(dcb), cap);
+  new (_p + 2)
+      PoolImpl(std::move(ccb), std::move(dcb), cap, shared_cap, idle_ms);
 }
 
 void *Pool::pop() const { return ((PoolImpl *)(_p + 2))->pop(); }
@@ -398,6 +976,9 @@ public:
   }
 
 private:
+  // A Chan may be shared by coroutines in any scheduler, and nothing tells a
+  // pipe that stays in one scheduler, so the mutex is always taken. It is not
+  // contended then, and is cheap next to the coroutine switches.
   ::Mutex _m;
   std::deque<waitx *> _wq;
   char *_buf;       // buffer
@@ -463,7 +1044,7 @@ void PipeImpl::read(void *p) {
             _wx = 0;
           _m.unlock();
 
-          ((co::SchedulerImpl *)w->co->s)->add_ready_task(w->co);
+          co::ready(w->co, s);
           return;
 
         } else { /* timeout */
@@ -502,7 +1083,7 @@ void PipeImpl::write(const void *p) {
         if (atomic_compare_swap(&w->state, st_init, st_ready) == st_init) {
           _m.unlock();
           memcpy(w->buf, p, _blk_size);
-          ((co::SchedulerImpl *)w->co->s)->add_ready_task(w->co);
+          co::ready(w->co, s); // hand the value over to the reader directly
           return;
         } else { /* timeout */
           free(w);
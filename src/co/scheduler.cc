@@ -37,7 +37,7 @@ void SchedulerImpl::stop() {
 void SchedulerImpl::main_func(tb_context_from_t from) {
   ((Coroutine *)from.priv)->ctx = from.ctx;
   gSched->running()->cb->run(); // run the coroutine function
-  tb_context_jump(from.ctx, 0); // jump back to the from context
+  tb_context_jump(gSched->_main_co->ctx, 0); // jump back to the main context
 }
 
 /*
@@ -191,6 +191,10 @@ void SchedulerImpl::loop() {
       }
     } while (0);
 
+    this->run_local_tasks();
+    if (!_local_tasks.empty())
+      _wait_ms = 0;
+
     if (_running)
       _running = 0;
   }
@@ -198,6 +202,42 @@ void SchedulerImpl::loop() {
   _ev.signal();
 }
 
+// Coroutines in the local task queue usually wake up each other, a ping-pong
+// on a channel for example. We resume them for a limited rounds here, and let
+// the scheduler check IO events and timers in between.
+void SchedulerImpl::run_local_tasks() {
+  for (int i = 0; i < 16 && !_local_tasks.empty(); ++i) {
+    CO_DBG_LOG << ">> resume local tasks, num: " << _local_tasks.size();
+    _local_swap.swap(_local_tasks);
+    for (size_t k = 0; k < _local_swap.size(); ++k) {
+      this->resume(_local_swap[k]);
+    }
+    _local_swap.clear();
+  }
+}
+
+void ready(CoList &l, SchedulerImpl *s) {
+  while (!l.empty()) {
+    Coroutine *co = l.pop_front();
+    SchedulerImpl *x = (SchedulerImpl *)co->s;
+    if (x == s) {
+      s->add_local_task(co);
+      continue;
+    }
+
+    CoList g;
+    g.push_back(co);
+    for (Coroutine *p = l.front(), *next; p; p = next) {
+      next = p->next;
+      if ((SchedulerImpl *)p->s == x) {
+        l.erase(p);
+        g.push_back(p);
+      }
+    }
+    x->add_ready_tasks(g);
+  }
+}
+
 uint32 TimerManager::check_timeout(std::vector<Coroutine *> &res) {
   if (_timer.empty())
     return (uint32)-1;
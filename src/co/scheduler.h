@@ -71,6 +71,9 @@ struct Coroutine {
     uint16 _00_;       // reserved
     void* waitx;       // wait info
     tb_context_t ctx;  // context, a pointer points to the stack bottom
+    Coroutine* prev;   // links for the intrusive list of waiting coroutines
+    Coroutine* next;
+    uint32 wn;         // number of resources the coroutine is waiting for
 
     // for saving stack data for this coroutine
     union { fastream stack; char _dummy1[sizeof(fastream)]; };
@@ -90,6 +93,77 @@ struct waitx_t {
     union { uint8 state; void* dummy; };
 };
 
+/**
+ * intrusive list of coroutines
+ *   - It uses the links in Coroutine, a coroutine can be in one list only.
+ *   - It is not thread-safe, users should protect it with a lock.
+ */
+class CoList {
+  public:
+    CoList() : _head(0), _tail(0) {}
+    ~CoList() = default;
+
+    bool empty() const { return _head == 0; }
+    Coroutine* front() const { return _head; }
+
+    void push_back(Coroutine* co) {
+        co->next = 0;
+        co->prev = _tail;
+        _tail ? (void)(_tail->next = co) : (void)(_head = co);
+        _tail = co;
+    }
+
+    void push_front(Coroutine* co) {
+        co->prev = 0;
+        co->next = _head;
+        _head ? (void)(_head->prev = co) : (void)(_tail = co);
+        _head = co;
+    }
+
+    Coroutine* pop_front() {
+        Coroutine* co = _head;
+        if (co) {
+            _head = co->next;
+            _head ? (void)(_head->prev = 0) : (void)(_tail = 0);
+            co->next = 0;
+        }
+        return co;
+    }
+
+    // check whether a coroutine is in the list. The coroutine MUST be either
+    // in this list or not in any list.
+    bool contains(const Coroutine* co) const {
+        return co->prev != 0 || _head == co;
+    }
+
+    void erase(Coroutine* co) {
+        co->prev ? (void)(co->prev->next = co->next) : (void)(_head = co->next);
+        co->next ? (void)(co->next->prev = co->prev) : (void)(_tail = co->prev);
+        co->prev = co->next = 0;
+    }
+
+    // move all coroutines to another list
+    void swap(CoList& l) {
+        std::swap(_head, l._head);
+        std::swap(_tail, l._tail);
+    }
+
+  private:
+    Coroutine* _head;
+    Coroutine* _tail;
+};
+
+// tell the cpu that we are in a spin-wait loop
+inline void cpu_relax() {
+  #if defined(_MSC_VER)
+    YieldProcessor();
+  #elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+  #elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+  #endif
+}
+
 // pool of Coroutine, using index as the coroutine id.
 class Copool {
   public:
@@ -149,6 +223,11 @@ class TaskManager {
         _ready_tasks.push_back(co);
     }
 
+    void add_ready_tasks(CoList& l) {
+        ::MutexGuard g(_mtx);
+        for (Coroutine* co; (co = l.pop_front());) _ready_tasks.push_back(co);
+    }
+
     void get_all_tasks(
         std::vector<Closure*>& new_tasks,
         std::vector<Coroutine*>& ready_tasks
@@ -234,7 +313,7 @@ class SchedulerImpl : public co::Scheduler {
     // suspend the current coroutine
     void yield() {
         if (_running->s != this) _running->s = this;
-        tb_context_jump(_main_co->ctx, _running);
+        _main_co->ctx = tb_context_jump(_main_co->ctx, _running).ctx;
     }
 
     // add a new task will run in a coroutine later (thread-safe)
@@ -249,6 +328,19 @@ class SchedulerImpl : public co::Scheduler {
         _epoll->signal();
     }
 
+    // add a list of coroutines ready to resume (thread-safe)
+    void add_ready_tasks(CoList& l) {
+        _task_mgr.add_ready_tasks(l);
+        _epoll->signal();
+    }
+
+    // add a coroutine of this scheduler ready to resume. It MUST be called in
+    // the scheduler thread. No lock or wakeup is needed, the coroutine will be
+    // resumed before the scheduler waits for IO events again.
+    void add_local_task(Coroutine* co) {
+        _local_tasks.push_back(co);
+    }
+
     // sleep for milliseconds in the current coroutine 
     void sleep(uint32 ms) {
         if (_wait_ms > ms) _wait_ms = ms;
@@ -315,6 +407,9 @@ class SchedulerImpl : public co::Scheduler {
     // the thread function
     void loop();
 
+    // resume coroutines in the local task queue
+    void run_local_tasks();
+
     // save stack for the coroutine
     void save_stack(Coroutine* co) {
         if (co) {
@@ -344,6 +439,8 @@ class SchedulerImpl : public co::Scheduler {
     Copool _co_pool;
     TaskManager _task_mgr;
     TimerManager _timer_mgr;
+    std::vector<Coroutine*> _local_tasks;
+    std::vector<Coroutine*> _local_swap;
 
     SyncEvent _ev;
     bool _stop;
@@ -377,6 +474,20 @@ class SchedulerManager {
 
 bool is_stopped();
 
+// Make a coroutine ready to resume. If it runs in the current scheduler, it
+// goes to the local task queue, otherwise to the task queue of its scheduler.
+inline void ready(Coroutine* co, SchedulerImpl* s) {
+    if ((SchedulerImpl*)co->s == s) {
+        s->add_local_task(co);
+    } else {
+        ((SchedulerImpl*)co->s)->add_ready_task(co);
+    }
+}
+
+// Make all coroutines in the list ready to resume. Coroutines are grouped by
+// scheduler, so each scheduler takes one lock and one wakeup for them.
+void ready(CoList& l, SchedulerImpl* s);
+
 extern __thread SchedulerImpl* gSched;
 
 namespace sock {
@@ -1,7 +1,15 @@
 #ifndef _WIN32
 
 #include "scheduler.h"
+#include <limits.h> // for IOV_MAX
 #include <unordered_map>
+#include <vector>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#include <netinet/udp.h> // for UDP_SEGMENT, UDP_GRO
+#endif
 
 namespace co {
 
@@ -40,6 +48,9 @@ int close(sock_t fd, int ms) {
   } else {
     co::get_sock_ctx(fd).del_event();
   }
+#ifdef __linux__
+  co::get_sock_ctx(fd).del_zerocopy();
+#endif
 
   int r;
   while ((r = CO_RAW_API(close)(fd)) != 0 && errno == EINTR)
@@ -139,6 +150,60 @@ int connect(sock_t fd, const void *addr, int addrlen, int ms) {
   } while (true);
 }
 
+#if defined(__linux__) && defined(MSG_FASTOPEN)
+// sendto() with MSG_FASTOPEN puts data in the SYN if we have a cookie from
+// the server, otherwise it sends a SYN with a cookie request and fails with
+// EINPROGRESS. It fails with EOPNOTSUPP if TFO is disabled for clients by
+// net.ipv4.tcp_fastopen.
+int connect_fastopen(sock_t fd, const void *addr, int addrlen, const void *buf,
+                     int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  int r;
+  do {
+    r = (int)CO_RAW_API(sendto)(fd, buf, n, MSG_FASTOPEN | MSG_NOSIGNAL,
+                                (const sockaddr *)addr, (socklen_t)addrlen);
+  } while (r == -1 && errno == EINTR);
+
+  if (r == -1) {
+    if (errno == EOPNOTSUPP) {
+      if (co::connect(fd, addr, addrlen, ms) != 0)
+        return -1;
+      return co::send(fd, buf, n, ms);
+    }
+    if (errno != EINPROGRESS)
+      return -1;
+    r = 0;
+  }
+
+  // wait for the handshake, the socket is not writable before it is done
+  do {
+    IoEvent ev(fd, ev_write);
+    if (!ev.wait(ms))
+      return -1;
+
+    int err, len = sizeof(err);
+    if (co::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+      return -1;
+    if (err != 0) {
+      errno = err;
+      return -1;
+    }
+  } while (0);
+
+  if (r < n && co::send(fd, (const char *)buf + r, n - r, ms) != n - r)
+    return -1;
+  return n;
+}
+
+#else
+int connect_fastopen(sock_t fd, const void *addr, int addrlen, const void *buf,
+                     int n, int ms) {
+  if (co::connect(fd, addr, addrlen, ms) != 0)
+    return -1;
+  return co::send(fd, buf, n, ms);
+}
+#endif
+
 int recv(sock_t fd, void *buf, int n, int ms) {
   CHECK(gSched) << "must be called in coroutine..";
   IoEvent ev(fd, ev_read);
@@ -253,6 +318,418 @@ int sendto(sock_t fd, const void *buf, int n, const void *addr, int addrlen,
   } while (true);
 }
 
+int recvv(sock_t fd, const iovec *iov, int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  IoEvent ev(fd, ev_read);
+
+  do {
+    int r = (int)CO_RAW_API(readv)(fd, iov, n < IOV_MAX ? n : IOV_MAX);
+    if (r != -1)
+      return r;
+
+    if (errno == EWOULDBLOCK || errno == EAGAIN) {
+      if (!ev.wait(ms))
+        return -1;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  } while (true);
+}
+
+int sendv(sock_t fd, const iovec *iov, int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  int total = 0;
+  for (int i = 0; i < n; ++i)
+    total += (int)iov[i].iov_len;
+
+  // The array is copied, as the element partially written will be adjusted.
+  iovec buf[16];
+  iovec *v = n <= 16 ? buf : (iovec *)::malloc(sizeof(iovec) * n);
+  memcpy(v, iov, sizeof(iovec) * n);
+  iovec *const p = v;
+  int remain = total;
+  IoEvent ev(fd, ev_write);
+
+  do {
+    int r = (int)CO_RAW_API(writev)(fd, v, n < IOV_MAX ? n : IOV_MAX);
+    if (r == remain)
+      break;
+
+    if (r == -1) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN) {
+        if (!ev.wait(ms)) {
+          total = -1;
+          break;
+        }
+      } else if (errno != EINTR) {
+        total = -1;
+        break;
+      }
+    } else {
+      remain -= r;
+      while (n > 0 && (size_t)r >= v->iov_len) {
+        r -= (int)v->iov_len;
+        ++v;
+        --n;
+      }
+      v->iov_base = (char *)v->iov_base + r;
+      v->iov_len -= r;
+    }
+  } while (true);
+
+  if (p != buf)
+    ::free(p);
+  return total;
+}
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+// Read zerocopy completions from the error queue of the socket. Each
+// completion covers a range of sends [ee_info, ee_data], @zc.done is moved
+// past the last send completed. Completions of an earlier call that timed out
+// may arrive here, sequence numbers tell them apart from sends of this call.
+static int reap_zerocopy(sock_t fd, SockCtx::zerocopy_t &zc) {
+  char control[128];
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+
+  do {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int r = (int)CO_RAW_API(recvmsg)(fd, &msg, MSG_ERRQUEUE);
+    if (r == -1) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN)
+        return 0;
+      if (errno != EINTR)
+        return -1;
+      continue;
+    }
+
+    for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (!(c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR) &&
+          !(c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      auto e = (sock_extended_err *)CMSG_DATA(c);
+      if (e->ee_origin != SO_EE_ORIGIN_ZEROCOPY || e->ee_errno != 0) {
+        errno = e->ee_errno ? (int)e->ee_errno : EIO;
+        return -1;
+      }
+      if ((int32)(e->ee_data + 1 - zc.done) > 0)
+        zc.done = e->ee_data + 1;
+    }
+  } while (true);
+}
+
+int send_zerocopy(sock_t fd, const void *buf, int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  if (n <= 0)
+    return co::send(fd, buf, n, ms);
+
+  // SO_ZEROCOPY is set once, the state is cleared by co::close().
+  auto &zc = co::get_sock_ctx(fd).zerocopy();
+  if (!zc.on) {
+    int one = 1;
+    if (co::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0)
+      return co::send(fd, buf, n, ms);
+    zc.on = 1;
+    zc.next = zc.done = 0;
+  }
+
+  const char *s = (const char *)buf;
+  int remain = n;
+  IoEvent ev(fd, ev_write);
+
+  // Completions wake up the coroutine waiting for ev_write, as the kernel
+  // reports EPOLLERR when the error queue is not empty.
+  while (remain > 0) {
+    int r = (int)CO_RAW_API(send)(fd, s, remain, MSG_ZEROCOPY);
+    if (r == -1) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN || errno == ENOBUFS) {
+        // ENOBUFS: too many completions not read yet
+        if (reap_zerocopy(fd, zc) != 0 || !ev.wait(ms))
+          return -1;
+      } else if (errno != EINTR) {
+        return -1;
+      }
+    } else {
+      ++zc.next; // a failed send takes no sequence number
+      remain -= r;
+      s += r;
+    }
+  }
+
+  // wait until the last send of this call has been completed
+  while (true) {
+    if (reap_zerocopy(fd, zc) != 0)
+      return -1;
+    if ((int32)(zc.done - zc.next) >= 0)
+      return n;
+    if (!ev.wait(ms))
+      return -1;
+  }
+}
+
+#else
+int send_zerocopy(sock_t fd, const void *buf, int n, int ms) {
+  return co::send(fd, buf, n, ms);
+}
+#endif
+
+#ifdef __linux__
+int64 sendfile(sock_t fd, int file_fd, int64 off, int64 n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  off_t pos = (off_t)off;
+  int64 remain = n;
+  IoEvent ev(fd, ev_write);
+
+  do {
+    const size_t x = remain < (1 << 30) ? (size_t)remain : (1 << 30);
+    ssize_t r = ::sendfile(fd, file_fd, &pos, x);
+    if (r == (ssize_t)remain)
+      return n;
+
+    if (r == -1) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN) {
+        if (!ev.wait(ms))
+          return -1;
+      } else if (errno != EINTR) {
+        return -1;
+      }
+    } else if (r == 0) {
+      return n - remain; // end of the file
+    } else {
+      remain -= r;
+    }
+  } while (true);
+}
+
+// A pipe is needed to splice data between two sockets. A call of splice()
+// owns a pipe until it returns, as data in the pipe belongs to its
+// connection, though the coroutine may be suspended. Empty pipes are kept in
+// a free list of each thread for reuse, and a pipe is closed if an error
+// occured, as there may be data left in it.
+struct SplicePipe {
+  int fds[2];
+};
+
+static __thread std::vector<SplicePipe> *g_pipes = 0;
+
+static bool get_pipe(SplicePipe *p) {
+  if (!g_pipes)
+    g_pipes = new std::vector<SplicePipe>();
+  if (!g_pipes->empty()) {
+    *p = g_pipes->back();
+    g_pipes->pop_back();
+    return true;
+  }
+  return ::pipe2(p->fds, O_NONBLOCK | O_CLOEXEC) == 0;
+}
+
+static void close_pipe(const SplicePipe &p) {
+  CO_RAW_API(close)(p.fds[0]);
+  CO_RAW_API(close)(p.fds[1]);
+}
+
+// the pipe MUST be empty
+static void put_pipe(const SplicePipe &p) {
+  if (g_pipes->size() < 16) {
+    g_pipes->push_back(p);
+  } else {
+    close_pipe(p);
+  }
+}
+
+int64 splice(sock_t from, sock_t to, int64 n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  SplicePipe pipe;
+  if (!get_pipe(&pipe))
+    return -1;
+
+  const int *p = pipe.fds;
+  const unsigned int flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+  int64 done = 0; // bytes written to @to
+  IoEvent rev(from, ev_read);
+  IoEvent wev(to, ev_write);
+
+  while (done < n) {
+    // socket -> pipe
+    const int64 x = n - done < (1 << 20) ? n - done : (1 << 20);
+    ssize_t r = ::splice(from, NULL, p[1], NULL, (size_t)x, flags);
+    if (r == 0)
+      break; // the peer closed the connection
+    if (r == -1) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN) {
+        if (!rev.wait(ms))
+          goto err;
+        continue;
+      } else if (errno != EINTR) {
+        goto err;
+      }
+      continue;
+    }
+
+    // pipe -> socket
+    for (ssize_t k = r; k > 0;) {
+      ssize_t w = ::splice(p[0], NULL, to, NULL, (size_t)k, flags);
+      if (w > 0) {
+        k -= w;
+        done += w;
+      } else if (w == -1 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+        if (!wev.wait(ms))
+          goto err;
+      } else if (w == 0 || errno != EINTR) {
+        goto err;
+      }
+    }
+  }
+  put_pipe(pipe);
+  return done;
+
+err:
+  close_pipe(pipe);
+  return -1;
+}
+
+#else
+int64 sendfile(sock_t fd, int file_fd, int64 off, int64 n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  const int64 N = 64 * 1024;
+  char *buf = (char *)::malloc(N);
+  int64 done = 0;
+  while (done < n) {
+    const int64 x = n - done < N ? n - done : N;
+    ssize_t r = ::pread(file_fd, buf, (size_t)x, (off_t)(off + done));
+    if (r <= 0 || co::send(fd, buf, (int)r, ms) != (int)r) {
+      if (r != 0)
+        done = -1;
+      break;
+    }
+    done += r;
+  }
+  ::free(buf);
+  return done;
+}
+
+int64 splice(sock_t from, sock_t to, int64 n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  const int64 N = 64 * 1024;
+  char *buf = (char *)::malloc(N);
+  int64 done = 0;
+  while (done < n) {
+    const int64 x = n - done < N ? n - done : N;
+    int r = co::recv(from, buf, (int)x, ms);
+    if (r <= 0 || co::send(to, buf, r, ms) != r) {
+      if (r != 0)
+        done = -1;
+      break;
+    }
+    done += r;
+  }
+  ::free(buf);
+  return done;
+}
+#endif
+
+#ifdef __linux__
+int recvmmsg(sock_t fd, mmsghdr *msgs, int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  IoEvent ev(fd, ev_read);
+  do {
+    int r = ::recvmmsg(fd, msgs, (unsigned int)n, MSG_DONTWAIT, NULL);
+    if (r != -1)
+      return r;
+
+    if (errno == EWOULDBLOCK || errno == EAGAIN) {
+      if (!ev.wait(ms))
+        return -1;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  } while (true);
+}
+
+// sendmmsg() may send only part of the messages if the socket buffer is full,
+// we continue from the first message not sent.
+int sendmmsg(sock_t fd, mmsghdr *msgs, int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  IoEvent ev(fd, ev_write);
+  int done = 0;
+  while (done < n) {
+    int r = ::sendmmsg(fd, msgs + done, (unsigned int)(n - done), MSG_DONTWAIT);
+    if (r > 0) {
+      done += r;
+    } else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+      if (!ev.wait(ms))
+        return -1;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return n;
+}
+
+#else
+int recvmmsg(sock_t fd, mmsghdr *msgs, int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  IoEvent ev(fd, ev_read);
+  int done = 0;
+  while (done < n) {
+    int r = (int)CO_RAW_API(recvmsg)(fd, &msgs[done].msg_hdr, 0);
+    if (r != -1) {
+      msgs[done++].msg_len = (unsigned int)r;
+    } else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+      if (done > 0)
+        break;
+      if (!ev.wait(ms))
+        return -1;
+    } else if (errno != EINTR) {
+      return done > 0 ? done : -1;
+    }
+  }
+  return done;
+}
+
+int sendmmsg(sock_t fd, mmsghdr *msgs, int n, int ms) {
+  CHECK(gSched) << "must be called in coroutine..";
+  IoEvent ev(fd, ev_write);
+  int done = 0;
+  while (done < n) {
+    int r = (int)CO_RAW_API(sendmsg)(fd, &msgs[done].msg_hdr, 0);
+    if (r != -1) {
+      msgs[done++].msg_len = (unsigned int)r;
+    } else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+      if (!ev.wait(ms))
+        return -1;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return n;
+}
+#endif
+
+int set_udp_gso(sock_t fd, int size) {
+#ifdef UDP_SEGMENT
+  return co::setsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &size, sizeof(size));
+#else
+  (void)fd;
+  (void)size;
+  errno = ENOPROTOOPT;
+  return -1;
+#endif
+}
+
+int set_udp_gro(sock_t fd) {
+#ifdef UDP_GRO
+  int v = 1;
+  return co::setsockopt(fd, IPPROTO_UDP, UDP_GRO, &v, sizeof(v));
+#else
+  (void)fd;
+  errno = ENOPROTOOPT;
+  return -1;
+#endif
+}
+
 class Error {
 public:
   Error() = default;
@@ -54,7 +54,7 @@ class SockCtx {
         _wev.c = co_id;
     }
 
-    void del_event() { memset(this, 0, sizeof(*this)); }
+    void del_event() { _r64 = 0; _w64 = 0; }
     void del_ev_read()  { _r64 = 0; }
     void del_ev_write() { _w64 = 0; }
 
@@ -81,6 +81,18 @@ class SockCtx {
         return _wev.s == sched_id ? _wev.c : 0;
     }
 
+    // state of MSG_ZEROCOPY sends on the socket, see co::send_zerocopy().
+    // The kernel numbers the sends from 0, and reports completed ranges of
+    // them on the error queue.
+    struct zerocopy_t {
+        uint32 on;   // SO_ZEROCOPY has been set
+        uint32 next; // sequence number of the next send
+        uint32 done; // all sends before it have been completed
+    };
+
+    zerocopy_t& zerocopy() { return _zc; }
+    void del_zerocopy() { memset(&_zc, 0, sizeof(_zc)); }
+
   private:
     struct event_t {
         int32 s; // scheduler id
@@ -88,6 +100,7 @@ class SockCtx {
     };
     union { event_t _rev; uint64 _r64; };
     union { event_t _wev; uint64 _w64; };
+    zerocopy_t _zc;
 };
 
 #else
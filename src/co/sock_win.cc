@@ -174,6 +174,15 @@ int connect(sock_t fd, const void *addr, int addrlen, int ms) {
   }
 }
 
+// TFO with ConnectEx() needs the TCP_FASTOPEN option set on the socket first,
+// we simply connect and then send data here.
+int connect_fastopen(sock_t fd, const void *addr, int addrlen, const void *buf,
+                     int n, int ms) {
+  if (co::connect(fd, addr, addrlen, ms) != 0)
+    return -1;
+  return co::send(fd, buf, n, ms);
+}
+
 int recv(sock_t fd, void *buf, int n, int ms) {
   CHECK(gSched) << "must be called in coroutine..";
   IoEvent ev(fd, ev_read);
@@ -308,6 +317,27 @@ int sendto(sock_t fd, const void *buf, int n, const void *addr, int addrlen,
   } while (true);
 }
 
+// Overlapped IO with IoEvent takes a single buffer, the buffers are received
+// or sent one by one here.
+int recvv(sock_t fd, const iovec *iov, int n, int ms) {
+  for (int i = 0; i < n; ++i) {
+    if (iov[i].iov_len > 0)
+      return co::recv(fd, iov[i].iov_base, (int)iov[i].iov_len, ms);
+  }
+  return 0;
+}
+
+int sendv(sock_t fd, const iovec *iov, int n, int ms) {
+  int total = 0;
+  for (int i = 0; i < n; ++i) {
+    const int x = (int)iov[i].iov_len;
+    if (x > 0 && co::send(fd, iov[i].iov_base, x, ms) != x)
+      return -1;
+    total += x;
+  }
+  return total;
+}
+
 void set_nonblock(sock_t fd) {
   unsigned long mode = 1;
   CO_RAW_API(ioctlsocket)(fd, FIONBIO, &mode);
@@ -776,10 +776,10 @@ void send_error_message(int err, http_res_t *res, tcp::Connection *conn) {
 }
 
 void ServerImpl::on_connection(tcp::Connection conn) {
-  char c;
   int r = 0;
-  size_t pos = 0, total_len = 0;
+  size_t pos = 0;
   fastring *buf = 0;
+  tcp::Reader reader(conn);
   Req req;
   Res res;
   auto &preq = *(http_req_t **)&req;
@@ -800,38 +800,34 @@ void ServerImpl::on_connection(tcp::Connection conn) {
   while (true) {
     { /* recv http header and body */
     recv_beg:
-      if (!buf) {
-        // try recieving a single byte
-        r = conn.recv(&c, 1, FLG_http_conn_idle_sec * 1000);
-        if (r == 0)
-          goto recv_zero_err;
-        if (r < 0) {
-          if (!co::timeout())
-            goto recv_err;
-          if (_conn_num > FLG_http_max_idle_conn)
-            goto idle_err;
-          goto recv_beg;
-        }
-        buf = (fastring *)_buffer.pop();
-        buf->clear();
-        buf->append(c);
+      // wait for the next request, the reader holds no buffer when idle.
+      r = reader.peek(1, FLG_http_conn_idle_sec * 1000);
+      if (r == 0)
+        goto recv_zero_err;
+      if (r < 0) {
+        if (!co::timeout())
+          goto recv_err;
+        if (_conn_num > FLG_http_max_idle_conn)
+          goto idle_err;
+        reader.release();
+        goto recv_beg;
       }
 
       // recv until the entire http header was done.
-      while ((pos = buf->find("\r\n\r\n")) == buf->npos) {
-        if (buf->size() > FLG_http_max_header_size)
+      r = reader.read_until("\r\n\r\n", 4, FLG_http_max_header_size,
+                            FLG_http_recv_timeout);
+      if (r == 0)
+        goto recv_zero_err;
+      if (r < 0) {
+        if (co::error() == EMSGSIZE)
           goto header_too_long_err;
-        buf->reserve(buf->size() + 1024);
-        r = conn.recv((void *)(buf->data() + buf->size()),
-                      (int)(buf->capacity() - buf->size()),
-                      FLG_http_recv_timeout);
-        if (r == 0)
-          goto recv_zero_err;
-        if (r < 0)
-          goto recv_err;
-        buf->resize(buf->size() + r);
+        goto recv_err;
       }
 
+      buf = (fastring *)_buffer.pop();
+      buf->clear();
+      buf->append(reader.data(), reader.size());
+      pos = buf->size() - 4;
       (*buf)[pos + 2] = '\0'; // make header null-terminated
       HTTPLOG << "http recv req: " << buf->data();
 
@@ -851,20 +847,19 @@ void ServerImpl::on_connection(tcp::Connection conn) {
         pres->version = preq->version;
       }
 
-      // try to recv the remain part of http body
+      // recv http body, data buffered by the reader is copied, and the rest
+      // is received into buf directly.
       preq->body = (uint32)(pos + 4); // beginning of http body
       if (preq->body_size > 0 ||
           strcmp(preq->header("Transfer-Encoding"), "chunked") != 0) {
-        total_len = pos + 4 + req.body_size();
-        if (preq->body_size > 0 && buf->size() < total_len) {
-          buf->reserve(total_len);
-          r = conn.recvn((void *)(buf->data() + buf->size()),
-                         (int)(total_len - buf->size()), FLG_http_recv_timeout);
+        if (preq->body_size > 0) {
+          buf->resize(pos + 4 + preq->body_size);
+          r = reader.read_exact((void *)(buf->data() + pos + 4),
+                                preq->body_size, FLG_http_recv_timeout);
           if (r == 0)
             goto recv_zero_err;
           if (r < 0)
             goto recv_err;
-          buf->resize(total_len);
         }
 
       } else { /* chunked Transfer-Encoding */
@@ -881,97 +876,75 @@ void ServerImpl::on_connection(tcp::Connection conn) {
          */
         god::om_mani_padme_hum();
 
-        bool expect_100_continue =
-            strcmp(preq->header("Expect"), "100-continue") == 0;
-        size_t x, o, i, n = 0;
-        fastring s(128);
-
-        if (buf->size() > pos + 4) {
-          s.append(buf->data() + pos + 4, buf->size() - pos - 4);
-          buf->resize(pos + 4);
+        if (reader.buffered() == 0 &&
+            strcmp(preq->header("Expect"), "100-continue") == 0) {
+          send_error_message(100, pres, &conn); /* send 100 continue */
         }
 
+        size_t o, i, n = 0;
         while (true) { /* loop for recving chunked data */
-          while ((x = s.find("\r\n")) == s.npos) {
-            if (expect_100_continue) { /* send 100 continue */
-              send_error_message(100, pres, &conn);
-            }
-            s.reserve(s.size() + 32);
-            r = conn.recv((void *)(s.data() + s.size()), 32,
-                          FLG_http_recv_timeout);
-            if (r == 0)
-              goto recv_zero_err;
-            if (r < 0)
-              goto recv_err;
-            s.resize(s.size() + r);
-          }
+          // chunked data:  1a[;xxx]\r\n data\r\n
+          r = reader.read_line(FLG_http_max_header_size, FLG_http_recv_timeout);
+          if (r == 0)
+            goto recv_zero_err;
+          if (r < 0)
+            goto recv_err;
 
-          if (x == 0) {
-            s.lshift(2);
+          const char *l = reader.data();
+          o = reader.size();
+          if (o == 0)
             continue;
-          }
-
-          // chunked data:  1a[;xxx]\r\n data\r\n
-          s[x] = '\0';
-          if ((o = s.find(';')) == s.npos)
-            o = x;
+          const char *e = (const char *)memchr(l, ';', o);
+          if (e)
+            o = e - l;
+          // stop before n overflows, a long size line may have many digits
           for (i = 0, n = 0; i < o; ++i) {
-            if ((r = hex2int(s[i])) < 0)
+            if ((r = hex2int(l[i])) < 0)
               goto chunk_err;
+            if (n > (FLG_http_max_body_size >> 4))
+              goto chunk_too_long_err;
             n = (n << 4) + r;
           }
 
           if (n > 0) {
-            o = s.size() - x - 2;
-            if (o < n) {
-              buf->append(s.data() + x + 2, o);
-              buf->reserve(buf->size() + n - o + 2);
-              r = conn.recvn((void *)(buf->data() + buf->size()),
-                             (int)(n - o + 2), FLG_http_recv_timeout);
-              if (r == 0)
-                goto recv_zero_err;
-              if (r < 0)
-                goto recv_err;
-              buf->resize(buf->size() + r - 2);
-              s.clear();
-            } else {
-              buf->append(s.data() + x + 2, n);
-              s.lshift(s.size() >= x + 4 + n ? x + 4 + n : x + 2 + n);
-            }
-
-            if (buf->size() - pos - 4 > FLG_http_max_body_size) {
-              send_error_message(413, pres, &conn);
-              goto err_end;
-            }
+            o = buf->size();
+            if (n > FLG_http_max_body_size - (o - pos - 4))
+              goto chunk_too_long_err;
+
+            buf->resize(o + n);
+            r = reader.read_exact((void *)(buf->data() + o), n,
+                                  FLG_http_recv_timeout);
+            if (r > 0)
+              r = reader.read_exact(2, FLG_http_recv_timeout); // \r\n
+            if (r == 0)
+              goto recv_zero_err;
+            if (r < 0)
+              goto recv_err;
 
           } else { /* n == 0, end of chunked data */
             preq->body_size = (uint32)(buf->size() - pos - 4);
-            s[x] = '\r';
-            s.lshift(x);
-            while ((x = s.find("\r\n\r\n")) == s.npos) {
-              s.reserve(s.size() + 32);
-              r = conn.recv((void *)(s.data() + s.size()), 32,
-                            FLG_http_recv_timeout);
+
+            // there may be some tailing headers following the chunked data
+            o = buf->size();
+            while (true) {
+              r = reader.read_until("\r\n", 2, FLG_http_max_header_size,
+                                    FLG_http_recv_timeout);
               if (r == 0)
                 goto recv_zero_err;
               if (r < 0)
                 goto recv_err;
-              s.resize(s.size() + r);
+              if (r == 2)
+                break;
+              buf->append(reader.data(), r);
             }
 
-            s[x + 2] = '\0';
-            if (s.size() > 4) { /* \r\n tailing headers \r\n\r\n*/
-              // there are some tailing headers following the chunked data
-              total_len = buf->size() + x + 4;
-              o = buf->size();
-              buf->append(s.data(), s.size());
-              r = parse_http_headers(buf, o + 2, preq);
+            if (buf->size() > o) {
+              buf->append('\0');
+              r = parse_http_headers(buf, o, preq);
               if (r != 0) {
                 send_error_message(r, pres, &conn);
                 goto err_end;
               }
-            } else {
-              total_len = buf->size();
             }
 
             break; // exit the chunked loop
@@ -1013,17 +986,11 @@ void ServerImpl::on_connection(tcp::Connection conn) {
       }
     };
 
-    if (buf->size() == total_len) {
-      buf->clear();
-      _buffer.push(buf);
-      buf = 0;
-    } else {
-      buf->lshift(total_len);
-    }
-
+    buf->clear();
+    _buffer.push(buf);
+    buf = 0;
     preq->clear();
     pres->clear();
-    total_len = 0;
   }
 
 recv_zero_err:
@@ -1048,6 +1015,10 @@ send_err:
 chunk_err:
   ELOG << "http invalid chunked data..";
   goto err_end;
+chunk_too_long_err:
+  ELOG << "http recv error: chunked body too long";
+  send_error_message(413, pres, &conn);
+  goto err_end;
 err_end:
   conn.reset(1000);
 cleanup:
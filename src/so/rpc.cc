@@ -169,13 +169,14 @@ void ServerImpl::on_connection(tcp::Connection conn) {
   int r = 0, len = 0;
   Header header;
   fastring *buf = 0;
+  tcp::Reader reader(conn);
   Json req, res;
 
   while (true) {
     // recv req from the client
     do {
     recv_beg:
-      r = conn.recvn(&header, sizeof(header), FLG_rpc_conn_idle_sec * 1000);
+      r = reader.read_exact(sizeof(header), FLG_rpc_conn_idle_sec * 1000);
 
       if (unlikely(r == 0))
         goto recv_zero_err;
@@ -190,9 +191,11 @@ void ServerImpl::on_connection(tcp::Connection conn) {
           _buffer.push(buf);
           buf = 0;
         }
+        reader.release();
         goto recv_beg;
       }
 
+      memcpy(&header, reader.data(), sizeof(header));
       if (unlikely(header.magic != kMagic))
         goto magic_err;
 
@@ -200,16 +203,14 @@ void ServerImpl::on_connection(tcp::Connection conn) {
       if (unlikely(len > FLG_rpc_max_msg_size))
         goto msg_too_long_err;
 
-      if (buf == NULL)
-        buf = (fastring *)_buffer.pop();
-      buf->resize(len);
-      r = conn.recvn((char *)buf->data(), len, FLG_rpc_recv_timeout);
-      if (unlikely(r == 0))
+      // parse the message in the buffer of the reader
+      r = reader.read_exact(len, FLG_rpc_recv_timeout);
+      if (unlikely(r == 0 && len > 0))
         goto recv_zero_err;
       if (unlikely(r < 0))
         goto recv_err;
 
-      req = json::parse(buf->data(), buf->size());
+      req = json::parse(reader.data(), reader.size());
       if (req.is_null())
         goto json_parse_err;
 
@@ -221,6 +222,8 @@ void ServerImpl::on_connection(tcp::Connection conn) {
       res.clear();
       this->process(req, res);
 
+      if (buf == NULL)
+        buf = (fastring *)_buffer.pop();
       buf->resize(sizeof(Header));
       res.str(*(fastream *)buf);
       set_header((void *)buf->data(), (int)buf->size() - sizeof(Header));
@@ -442,16 +445,28 @@ json_parse_err:
 class ClientImpl {
 public:
   ClientImpl(const char *ip, int port, bool use_ssl)
-      : _tcp_cli(ip, port, use_ssl) {}
+      : _tcp_cli(ip, port, use_ssl), _pool(0), _port(port) {}
+
+  ClientImpl(tcp::ConnPool &pool, const char *ip, int port)
+      : _tcp_cli(ip, port), _pool(&pool), _ip(ip && *ip ? ip : "127.0.0.1"),
+        _port(port) {}
 
   ClientImpl(const ClientImpl &c)
-      : _tcp_cli(c._tcp_cli), _user(c._user), _pass(c._pass) {}
+      : _tcp_cli(c._tcp_cli), _pool(c._pool), _ip(c._ip), _port(c._port),
+        _user(c._user), _pass(c._pass) {}
 
   ~ClientImpl() = default;
 
   void call(const Json &req, Json &res);
 
+  // connections of a pool are shared by all clients, the credentials are set
+  // on the pool by rpc::set_userpass(pool, ...)
   void set_userpass(const char *user, const char *pass) {
+    if (_pool) {
+      WLOG << "set_userpass() ignored for a client using a pool, "
+           << "call rpc::set_userpass(pool, ...) instead";
+      return;
+    }
     if (user && *user && pass && *pass) {
       _user = user;
       _pass = md5sum(pass);
@@ -460,20 +475,29 @@ public:
 
   void close() { _tcp_cli.disconnect(); }
 
+  static bool auth(tcp::Client &c, const fastring &user, const fastring &pass);
+
 private:
   tcp::Client _tcp_cli;
+  tcp::ConnPool *_pool; // connections are taken from the pool if not NULL
+  fastring _ip;
+  int _port;
   fastring _user;
   fastring _pass;
   fastream _fs;
 
-  bool auth();
   bool connect();
+  void call(tcp::Client &c, const Json &req, Json &res);
 };
 
 Client::Client(const char *ip, int port, bool use_ssl) {
   _p = new ClientImpl(ip, port, use_ssl);
 }
 
+Client::Client(tcp::ConnPool &pool, const char *ip, int port) {
+  _p = new ClientImpl(pool, ip, port);
+}
+
 Client::Client(const Client &c) { _p = new ClientImpl(*(ClientImpl *)c._p); }
 
 Client::~Client() { delete (ClientImpl *)_p; }
@@ -482,6 +506,14 @@ void Client::set_userpass(const char *user, const char *pass) {
   ((ClientImpl *)_p)->set_userpass(user, pass);
 }
 
+void set_userpass(tcp::ConnPool &pool, const char *user, const char *pass) {
+  if (user && *user && pass && *pass) {
+    fastring u(user), p(md5sum(pass));
+    pool.on_connect(
+        [u, p](tcp::Client &c) { return ClientImpl::auth(c, u, p); });
+  }
+}
+
 void Client::call(const Json &req, Json &res) {
   return ((ClientImpl *)_p)->call(req, res);
 }
@@ -497,7 +529,7 @@ void Client::ping() {
 bool ClientImpl::connect() {
   if (!_tcp_cli.connect(FLG_rpc_conn_timeout))
     return false;
-  if (!_pass.empty() && !this->auth()) {
+  if (!_pass.empty() && !ClientImpl::auth(_tcp_cli, _user, _pass)) {
     _tcp_cli.disconnect();
     return false;
   }
@@ -505,11 +537,23 @@ bool ClientImpl::connect() {
 }
 
 void ClientImpl::call(const Json &req, Json &res) {
-  int r = 0, len = 0;
-  Header header;
+  if (_pool) {
+    tcp::ConnGuard c(*_pool, _ip.c_str(), _port, FLG_rpc_conn_timeout);
+    if (c)
+      this->call(*c, req, res);
+    return;
+  }
 
-  if (!_tcp_cli.connected() && !this->connect())
+  // without auth, the first request is sent by connect() in call(c, ...)
+  if (!_tcp_cli.connected() && !_pass.empty() && !this->connect())
     return;
+  this->call(_tcp_cli, req, res);
+}
+
+// On error, the connection is closed, and it will be dropped by the pool.
+void ClientImpl::call(tcp::Client &c, const Json &req, Json &res) {
+  int r = 0, len = 0;
+  Header header;
 
   // send request
   do {
@@ -517,7 +561,14 @@ void ClientImpl::call(const Json &req, Json &res) {
     req.str(_fs);
     set_header((void *)_fs.data(), (int)_fs.size() - sizeof(Header));
 
-    r = _tcp_cli.send(_fs.data(), (int)_fs.size(), FLG_rpc_send_timeout);
+    if (c.connected()) {
+      r = c.send(_fs.data(), (int)_fs.size(), FLG_rpc_send_timeout);
+    } else {
+      // send the request with the SYN by TCP Fast Open
+      r = c.connect(FLG_rpc_conn_timeout, _fs.data(), (int)_fs.size())
+              ? (int)_fs.size()
+              : -1;
+    }
     if (unlikely(r <= 0))
       goto send_err;
 
@@ -526,7 +577,7 @@ void ClientImpl::call(const Json &req, Json &res) {
 
   // wait for response
   do {
-    r = _tcp_cli.recvn(&header, sizeof(header), FLG_rpc_recv_timeout);
+    r = c.recvn(&header, sizeof(header), FLG_rpc_recv_timeout);
     if (unlikely(r == 0))
       goto recv_zero_err;
     if (unlikely(r < 0))
@@ -539,7 +590,7 @@ void ClientImpl::call(const Json &req, Json &res) {
       goto msg_too_long_err;
 
     _fs.resize(len);
-    r = _tcp_cli.recvn((char *)_fs.data(), len, FLG_rpc_recv_timeout);
+    r = c.recvn((char *)_fs.data(), len, FLG_rpc_recv_timeout);
     if (unlikely(r == 0))
       goto recv_zero_err;
     if (unlikely(r < 0))
@@ -562,19 +613,20 @@ recv_zero_err:
   ELOG << "rpc server close the connection..";
   goto err_end;
 recv_err:
-  ELOG << "rpc recv error: " << _tcp_cli.strerror();
+  ELOG << "rpc recv error: " << c.strerror();
   goto err_end;
 send_err:
-  ELOG << "rpc send error: " << _tcp_cli.strerror();
+  ELOG << "rpc send error: " << c.strerror();
   goto err_end;
 json_parse_err:
   ELOG << "rpc json parse error: " << _fs;
   goto err_end;
 err_end:
-  _tcp_cli.disconnect();
+  c.disconnect();
 }
 
-bool ClientImpl::auth() {
+bool ClientImpl::auth(tcp::Client &c, const fastring &user,
+                      const fastring &pass) {
   int r = 0, len = 0;
   Header header;
   fastream fs;
@@ -589,14 +641,14 @@ bool ClientImpl::auth() {
     req.str(fs);
     set_header((void *)fs.data(), (int)fs.size() - sizeof(header));
 
-    r = _tcp_cli.send(fs.data(), (int)fs.size(), FLG_rpc_send_timeout);
+    r = c.send(fs.data(), (int)fs.size(), FLG_rpc_send_timeout);
     if (unlikely(r <= 0))
       goto send_err;
   } while (0);
 
   // recv the first response from server
   do {
-    r = _tcp_cli.recv(&header, sizeof(header), FLG_rpc_recv_timeout);
+    r = c.recv(&header, sizeof(header), FLG_rpc_recv_timeout);
     if (unlikely(r == 0))
       goto recv_zero_err;
     if (unlikely(r < 0))
@@ -609,7 +661,7 @@ bool ClientImpl::auth() {
       goto msg_too_long_err;
 
     fs.resize(len);
-    r = _tcp_cli.recvn((char *)fs.data(), len, FLG_rpc_recv_timeout);
+    r = c.recvn((char *)fs.data(), len, FLG_rpc_recv_timeout);
     if (unlikely(r == 0))
       goto recv_zero_err;
     if (unlikely(r < 0))
@@ -630,14 +682,14 @@ bool ClientImpl::auth() {
       return false;
     }
 
-    req.add_member("username", _user);
-    req.add_member("md5", md5sum(_pass + x.get_string()));
+    req.add_member("username", user);
+    req.add_member("md5", md5sum(pass + x.get_string()));
 
     fs.resize(sizeof(header));
     req.str(fs);
     set_header((void *)fs.data(), (int)fs.size() - sizeof(header));
 
-    r = _tcp_cli.send(fs.data(), (int)fs.size(), FLG_rpc_send_timeout);
+    r = c.send(fs.data(), (int)fs.size(), FLG_rpc_send_timeout);
     if (unlikely(r <= 0))
       goto send_err;
 
@@ -646,7 +698,7 @@ bool ClientImpl::auth() {
 
   // recv the final auth response from server
   do {
-    r = _tcp_cli.recv(&header, sizeof(header), FLG_rpc_recv_timeout);
+    r = c.recv(&header, sizeof(header), FLG_rpc_recv_timeout);
     if (unlikely(r == 0))
       goto recv_zero_err;
     if (unlikely(r < 0))
@@ -659,7 +711,7 @@ bool ClientImpl::auth() {
       goto msg_too_long_err;
 
     fs.resize(len);
-    r = _tcp_cli.recvn((char *)fs.data(), len, FLG_rpc_recv_timeout);
+    r = c.recvn((char *)fs.data(), len, FLG_rpc_recv_timeout);
     if (unlikely(r == 0))
       goto recv_zero_err;
     if (unlikely(r < 0))
@@ -690,10 +742,10 @@ recv_zero_err:
   ELOG << "server close the connection..";
   return false;
 recv_err:
-  ELOG << "recv error: " << _tcp_cli.strerror();
+  ELOG << "recv error: " << c.strerror();
   return false;
 send_err:
-  ELOG << "send error: " << _tcp_cli.strerror();
+  ELOG << "send error: " << c.strerror();
   return false;
 json_parse_err:
   ELOG << "json parse error: " << fs;
@@ -4,8 +4,17 @@
 #include "co/fastream.h"
 #include "co/log.h"
 #include "co/thread.h"
+#include "co/time.h"
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
 #include <openssl/ssl.h>
+#include <vector>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
 
 namespace ssl {
 
@@ -48,6 +57,182 @@ C *new_ctx(char c) {
 
 void free_ctx(C *c) { SSL_CTX_free((SSL_CTX *)c); }
 
+// A session ticket key. Tickets are encrypted with aes and signed with hmac,
+// and the name in a ticket tells which key to use.
+struct TicketKey {
+  unsigned char name[16];
+  unsigned char aes[32];
+  unsigned char hmac[32];
+  int64 created; // in seconds
+};
+
+// Ticket keys of a SSL_CTX, keys[0] is the current key for new tickets.
+struct TicketKeys {
+  ::Mutex mtx;
+  int rotate;
+  std::vector<TicketKey> keys;
+};
+
+static void free_ticket_keys(void *, void *p, CRYPTO_EX_DATA *, int, long,
+                             void *) {
+  delete (TicketKeys *)p;
+}
+
+// TicketKeys are freed with the SSL_CTX
+static int ticket_keys_index() {
+  static int x = SSL_CTX_get_ex_new_index(0, 0, 0, 0, free_ticket_keys);
+  return x;
+}
+
+// Get the key to encrypt a new ticket if name is NULL, otherwise the key
+// with the name. Keys are rotated here, and a key is dropped when tickets
+// encrypted with it have expired.
+// return 1 for the current key, 2 for an old key, 0 if not found.
+static int get_ticket_key(SSL_CTX *c, const unsigned char *name,
+                          TicketKey *k) {
+  TicketKeys *t = (TicketKeys *)SSL_CTX_get_ex_data(c, ticket_keys_index());
+  if (t == NULL)
+    return 0;
+
+  const int64 now = now::ms() / 1000;
+  ::MutexGuard g(t->mtx);
+  auto &v = t->keys;
+  if (v.empty() || now - v[0].created >= t->rotate) {
+    TicketKey x;
+    x.created = now;
+    if (RAND_bytes(x.name, sizeof(x.name)) == 1 &&
+        RAND_bytes(x.aes, sizeof(x.aes)) == 1 &&
+        RAND_bytes(x.hmac, sizeof(x.hmac)) == 1) {
+      v.insert(v.begin(), x);
+    } else if (v.empty()) {
+      return 0;
+    }
+  }
+
+  const int64 life = t->rotate + SSL_CTX_get_timeout(c);
+  while (v.size() > 1 && now - v.back().created >= life)
+    v.pop_back();
+
+  if (name == NULL) {
+    *k = v[0];
+    return 1;
+  }
+  for (size_t i = 0; i < v.size(); ++i) {
+    if (memcmp(v[i].name, name, sizeof(v[i].name)) == 0) {
+      *k = v[i];
+      return i == 0 ? 1 : 2;
+    }
+  }
+  return 0;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int ticket_key_cb(SSL *s, unsigned char *name, unsigned char *iv,
+                         EVP_CIPHER_CTX *ctx, EVP_MAC_CTX *hctx, int enc) {
+#else
+static int ticket_key_cb(SSL *s, unsigned char *name, unsigned char *iv,
+                         EVP_CIPHER_CTX *ctx, HMAC_CTX *hctx, int enc) {
+#endif
+  TicketKey k;
+  const int r = get_ticket_key(SSL_get_SSL_CTX(s), enc ? NULL : name, &k);
+  if (r == 0)
+    return enc ? -1 : 0; // a ticket of unknown key, do a full handshake
+
+  if (enc) {
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+      return -1;
+    memcpy(name, k.name, sizeof(k.name));
+    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, k.aes, iv) != 1)
+      return -1;
+  } else {
+    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, k.aes, iv) != 1)
+      return -1;
+  }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  OSSL_PARAM params[3];
+  params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, k.hmac,
+                                                sizeof(k.hmac));
+  params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                               (char *)"SHA256", 0);
+  params[2] = OSSL_PARAM_construct_end();
+  if (EVP_MAC_CTX_set_params(hctx, params) != 1)
+    return -1;
+#else
+  if (HMAC_Init_ex(hctx, k.hmac, sizeof(k.hmac), EVP_sha256(), NULL) != 1)
+    return -1;
+#endif
+  return r; // 2 tells openssl to issue a new ticket with the current key
+}
+
+int set_session_cache(C *c, int size, int timeout) {
+  SSL_CTX *x = (SSL_CTX *)c;
+  if (size > 0) {
+    SSL_CTX_set_session_cache_mode(x, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(x, size);
+  } else {
+    SSL_CTX_set_session_cache_mode(x, SSL_SESS_CACHE_OFF);
+  }
+  if (timeout > 0)
+    SSL_CTX_set_timeout(x, timeout);
+
+  static const unsigned char sid_ctx[] = "co";
+  return SSL_CTX_set_session_id_context(x, sid_ctx, sizeof(sid_ctx) - 1);
+}
+
+int enable_session_tickets(C *c, int rotate) {
+  SSL_CTX *x = (SSL_CTX *)c;
+  if (rotate <= 0) {
+    SSL_CTX_set_options(x, SSL_OP_NO_TICKET);
+    return 1;
+  }
+
+  TicketKeys *t = (TicketKeys *)SSL_CTX_get_ex_data(x, ticket_keys_index());
+  if (t == NULL) {
+    t = new TicketKeys();
+    if (SSL_CTX_set_ex_data(x, ticket_keys_index(), t) != 1) {
+      delete t;
+      return 0;
+    }
+  }
+  do {
+    ::MutexGuard g(t->mtx);
+    t->rotate = rotate;
+  } while (0);
+
+  SSL_CTX_clear_options(x, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  return (int)SSL_CTX_set_tlsext_ticket_key_evp_cb(x, ticket_key_cb);
+#else
+  return (int)SSL_CTX_set_tlsext_ticket_key_cb(x, ticket_key_cb);
+#endif
+}
+
+Session *get_session(S *s) {
+  SSL *x = (SSL *)s;
+  SSL_SESSION *p = SSL_get1_session(x);
+  if (p == NULL)
+    return 0;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  if (!SSL_SESSION_is_resumable(p)) {
+    SSL_SESSION_free(p);
+    return 0;
+  }
+#endif
+  // SSL_free() marks the session not resumable if the connection was not
+  // shut down, the connection is going to be closed anyway.
+  SSL_set_shutdown(x, SSL_get_shutdown(x) | SSL_SENT_SHUTDOWN);
+  return (Session *)p;
+}
+
+int set_session(S *s, Session *x) {
+  return SSL_set_session((SSL *)s, (SSL_SESSION *)x);
+}
+
+void free_session(Session *x) { SSL_SESSION_free((SSL_SESSION *)x); }
+
+bool session_reused(const S *s) { return SSL_session_reused((SSL *)s) == 1; }
+
 void *new_ssl(C *c) { return (void *)SSL_new((SSL_CTX *)c); }
 
 void free_ssl(S *s) { SSL_free((SSL *)s); }
@@ -68,6 +253,21 @@ int check_private_key(const C *c) {
   return SSL_CTX_check_private_key((const SSL_CTX *)c);
 }
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS)
+int enable_ktls(C *c) {
+  SSL_CTX_set_options((SSL_CTX *)c, SSL_OP_ENABLE_KTLS);
+  return 1;
+}
+
+bool ktls_send(S *s) { return BIO_get_ktls_send(SSL_get_wbio((SSL *)s)); }
+
+bool ktls_recv(S *s) { return BIO_get_ktls_recv(SSL_get_rbio((SSL *)s)); }
+#else
+int enable_ktls(C *) { return 0; }
+bool ktls_send(S *) { return false; }
+bool ktls_recv(S *) { return false; }
+#endif
+
 int shutdown(S *s, int ms) {
   CHECK(co::scheduler()) << "must be called in coroutine..";
   int r, e;
@@ -141,6 +341,23 @@ int accept(S *s, int ms) {
   } while (true);
 }
 
+int try_accept(S *s, int *ev) {
+  ERR_clear_error();
+  const int r = SSL_accept((SSL *)s);
+  *ev = 0;
+  if (r == 1)
+    return 1;
+  if (r < 0) {
+    const int e = SSL_get_error((SSL *)s, r);
+    if (e == SSL_ERROR_WANT_READ) {
+      *ev = co::ev_read;
+    } else if (e == SSL_ERROR_WANT_WRITE) {
+      *ev = co::ev_write;
+    }
+  }
+  return r;
+}
+
 int connect(S *s, int ms) {
   CHECK(co::scheduler()) << "must be called in coroutine..";
   int r, e;
@@ -289,6 +506,17 @@ int send(S *s, const void *buf, int n, int ms) {
   } while (true);
 }
 
+bool alive(S *s) {
+  char x;
+  ERR_clear_error();
+  const int r = SSL_peek((SSL *)s, &x, 1);
+  if (r > 0)
+    return false;
+  const int e = SSL_get_error((SSL *)s, r);
+  ERR_clear_error();
+  return e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE;
+}
+
 bool timeout() { return co::timeout(); }
 
 } // namespace ssl
@@ -318,12 +546,26 @@ int get_fd(const S *) { return 0; }
 int use_private_key_file(C *, const char *) { return 0; }
 int use_certificate_file(C *, const char *) { return 0; }
 int check_private_key(const C *) { return 0; }
+int set_session_cache(C *, int, int) { return 0; }
+int enable_session_tickets(C *, int) { return 0; }
+Session *get_session(S *) { return 0; }
+int set_session(S *, Session *) { return 0; }
+void free_session(Session *) {}
+bool session_reused(const S *) { return false; }
+int enable_ktls(C *) { return 0; }
+bool ktls_send(S *) { return false; }
+bool ktls_recv(S *) { return false; }
 int shutdown(S *, int) { return 0; }
 int accept(S *, int) { return 0; }
+int try_accept(S *, int *ev) {
+  *ev = 0;
+  return 0;
+}
 int connect(S *, int) { return 0; }
 int recv(S *, void *, int, int) { return 0; }
 int recvn(S *, void *, int, int) { return 0; }
 int send(S *, const void *, int, int) { return 0; }
+bool alive(S *) { return false; }
 bool timeout() { return false; }
 
 } // namespace ssl
@@ -4,26 +4,346 @@
 #include "co/log.h"
 #include "co/so/ssl.h"
 #include "co/str.h"
+#include "co/thread.h"
 #include "co/time.h"
+#include "../co/hook.h"
+#include <stddef.h>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <sys/un.h>
+#endif
 
 DEF_int32(ssl_handshake_timeout, 3000, "#2 ssl handshake timeout in ms");
+DEF_int32(ssl_session_cache, 20480,
+          "#2 max sessions cached by a ssl server for resumption, 0 to "
+          "disable the cache");
+DEF_int32(ssl_session_timeout, 300,
+          "#2 lifetime in seconds of ssl sessions and session tickets");
+DEF_int32(ssl_ticket_rotate, 3600,
+          "#2 a ssl server rotates its session ticket keys every this many "
+          "seconds, 0 to disable session tickets");
+DEF_bool(ssl_session_reuse, true,
+         "#2 ssl clients resume the last session with the same server");
+DEF_int32(ssl_handshake_threads, 0,
+          "#2 threads running the CPU-heavy part of ssl handshakes for ssl "
+          "servers, 0 to run handshakes in the schedulers");
+DEF_bool(ssl_ktls, false,
+         "#2 ssl servers hand records to kernel TLS (kTLS) after handshakes if "
+         "possible, linux only");
+DEF_bool(tcp_reuseport, false,
+         "#2 tcp server listens with a SO_REUSEPORT socket in each scheduler, "
+         "connections are served in the scheduler that accepted them");
+DEF_bool(tcp_incoming_cpu, false,
+         "#2 tcp server dispatches a connection to the scheduler matching the "
+         "CPU that handled it (SO_INCOMING_CPU), linux only");
+DEF_int32(tcp_max_conns, 0,
+          "#2 max concurrent connections of a tcp server, 0 for unlimited");
+DEF_int32(tcp_max_accept_rate, 0,
+          "#2 max connections a tcp server accepts per second, 0 for unlimited");
+DEF_string(tcp_overload, "reject",
+           "#2 what a tcp server does when a limit is reached: reject (reset "
+           "new connections), delay (stop accepting for a while), pause "
+           "(close the listening socket for a while)");
+DEF_int32(tcp_zerocopy_min, 0,
+          "#2 send data of at least this size with MSG_ZEROCOPY on plain tcp "
+          "connections, 0 to disable it, linux only");
+DEF_bool(tcp_conn_stats, false,
+         "#2 keep traffic counters for each tcp connection and client, and sum "
+         "them up for tcp servers");
+DEF_int32(tcp_fastopen, 0,
+          "#2 length of the TCP Fast Open queue of a tcp server, 0 to disable "
+          "TFO on the server");
+DEF_int32(tcp_defer_accept, 0,
+          "#2 tcp server accepts a connection only when data arrived, or after "
+          "this many seconds (TCP_DEFER_ACCEPT), 0 to disable it, linux only");
+
+namespace co {
+bool is_stopped(); // defined in scheduler.cc
+} // namespace co
 
 namespace tcp {
 
+#ifndef _WIN32
+static bool is_unix(const char *ip) { return strncmp(ip, "unix:", 5) == 0; }
+
+// "unix:/path" is a path in the file system, and "unix:@name" is a name in the
+// abstract namespace (linux only). It returns size of the address, or 0 if the
+// path is empty or too long.
+static int unix_addr(const char *ip, struct sockaddr_un *a) {
+  const char *p = ip + 5;
+  const size_t n = strlen(p);
+  if (n == 0 || n >= sizeof(a->sun_path))
+    return 0;
+  memset(a, 0, sizeof(*a));
+  a->sun_family = AF_UNIX;
+  memcpy(a->sun_path, p, n);
+  if (*p == '@') {
+    a->sun_path[0] = '\0';
+    return (int)(offsetof(struct sockaddr_un, sun_path) + n);
+  }
+  return (int)(offsetof(struct sockaddr_un, sun_path) + n + 1);
+}
+#endif
+
+// SSL_CTX shared by ssl clients, and the last session with each server. A
+// new connection resumes the session, which saves the public key operations
+// of a full handshake.
+class SSLClients {
+public:
+  enum { kMaxSessions = 1024 };
+
+  // NULL on error
+  ssl::C *ctx() {
+    static ssl::C *c = ssl::new_client_ctx();
+    return c;
+  }
+
+  // set the last session with the server to s
+  void resume(const fastring &key, ssl::S *s) {
+    ::MutexGuard g(_mtx);
+    auto it = _sess.find(key);
+    if (it != _sess.end())
+      ssl::set_session(s, it->second);
+  }
+
+  // save the session of s for the next connection to the server
+  void save(const fastring &key, ssl::S *s) {
+    ssl::Session *x = ssl::get_session(s);
+    if (x == NULL)
+      return;
+
+    ::MutexGuard g(_mtx);
+    auto it = _sess.find(key);
+    if (it != _sess.end()) {
+      ssl::free_session(it->second);
+      it->second = x;
+      return;
+    }
+    if (_sess.size() >= kMaxSessions) {
+      it = _sess.begin();
+      ssl::free_session(it->second);
+      _sess.erase(it);
+    }
+    _sess.insert(std::make_pair(key, x));
+  }
+
+private:
+  ::Mutex _mtx;
+  std::unordered_map<fastring, ssl::Session *> _sess; // ip:port -> session
+};
+
+// never freed, sessions may be saved by clients destructed at exit
+static SSLClients *ssl_clients() {
+  static SSLClients *x = new SSLClients();
+  return x;
+}
+
+// key of a server in SSLClients
+static fastring endpoint(const char *ip, int port) {
+  fastring s(ip);
+  s << ':' << port;
+  return s;
+}
+
+// Threads running ssl handshakes out of the schedulers. A connection waits
+// for IO in its coroutine, and each step of the handshake that follows is
+// done in a thread of the pool, so a burst of new connections will not
+// stall established connections in the schedulers.
+class HandshakePool {
+public:
+  struct Task {
+    ssl::S *s;
+    int r;
+    int ev;
+    fastring err; // error message from the pool thread
+    co::Event done;
+  };
+
+  explicit HandshakePool(int n) {
+    co::xx::cond_init(&_cond);
+    for (int i = 0; i < n; ++i)
+      Thread(&HandshakePool::loop, this).detach();
+  }
+
+  // the same as ssl::accept(), but err is set to the error message of ssl
+  int accept(ssl::S *s, int ms, fastring *err) {
+    const int fd = ssl::get_fd(s);
+    if (fd < 0)
+      return -1;
+
+    int ev = co::ev_read; // wait for the client hello first
+    while (true) {
+      do {
+        co::IoEvent x(fd, (co::io_event_t)ev);
+        if (!x.wait(ms))
+          return -1;
+      } while (0);
+
+      // The task is not on the stack, which may be shared by coroutines and
+      // swapped out while this coroutine is waiting.
+      std::unique_ptr<Task> t(new Task());
+      t->s = s;
+      do {
+        ::MutexGuard g(_mtx);
+        _tasks.push_back(t.get());
+        co::xx::cond_notify(&_cond);
+      } while (0);
+      t->done.wait();
+      if (t->r == 1)
+        return 1;
+      if (t->ev == 0) {
+        *err = t->err;
+        return t->r;
+      }
+      ev = t->ev;
+    }
+  }
+
+private:
+  void loop() {
+    while (true) {
+      Task *t;
+      do {
+        ::MutexGuard g(_mtx);
+        while (_tasks.empty())
+          co::xx::cond_wait(&_cond, _mtx.mutex());
+        t = _tasks.front();
+        _tasks.pop_front();
+      } while (0);
+
+      t->r = ssl::try_accept(t->s, &t->ev);
+      if (t->r != 1 && t->ev == 0)
+        t->err = ssl::strerror(t->s);
+
+      // t may be destroyed once done is signaled
+      co::Event done(t->done);
+      done.signal();
+    }
+  }
+
+  ::Mutex _mtx;
+  co::xx::cond_t _cond;
+  std::deque<Task *> _tasks;
+};
+
+// shared by ssl servers, never freed as the threads never exit
+static HandshakePool *handshake_pool() {
+  static HandshakePool *x = new HandshakePool(FLG_ssl_handshake_threads);
+  return x;
+}
+
+// SSL has no scatter/gather IO, data is received into the first buffer that
+// is not empty.
+static int ssl_recvv(ssl::S *s, const co::iovec *iov, int n, int ms) {
+  for (int i = 0; i < n; ++i) {
+    if (iov[i].iov_len > 0)
+      return ssl::recv(s, iov[i].iov_base, (int)iov[i].iov_len, ms);
+  }
+  return 0;
+}
+
+// Small buffers are copied together to be sent in one SSL record, others are
+// sent one by one.
+static int ssl_sendv(ssl::S *s, const co::iovec *iov, int n, int ms) {
+  int total = 0;
+  for (int i = 0; i < n; ++i)
+    total += (int)iov[i].iov_len;
+
+  if (total <= 4096) {
+    char buf[4096];
+    char *p = buf;
+    for (int i = 0; i < n; ++i) {
+      memcpy(p, iov[i].iov_base, iov[i].iov_len);
+      p += iov[i].iov_len;
+    }
+    return ssl::send(s, buf, total, ms);
+  }
+
+  for (int i = 0; i < n; ++i) {
+    const int x = (int)iov[i].iov_len;
+    if (x > 0) {
+      const int r = ssl::send(s, iov[i].iov_base, x, ms);
+      if (r != x)
+        return r;
+    }
+  }
+  return total;
+}
+
+// traffic counters of a server in a scheduler, padded to a cache line
+struct ServerTraffic {
+  ConnStats st;
+  char _pad[64 - sizeof(ConnStats) % 64];
+};
+
+// Add the result of an IO call to counters of a connection, and to counters of
+// the server in the current scheduler. Counters of a connection are updated
+// only by the coroutine using it, while counters of a server may be read by
+// other threads.
+static void add_traffic(ConnStats *c, ServerTraffic *s, bool in, int64 r,
+                        int64 us) {
+  const uint64 n = r > 0 ? (uint64)r : 0;
+  if (in) {
+    c->bytes_in += n;
+    c->recv_calls++;
+    c->recv_us += us;
+  } else {
+    c->bytes_out += n;
+    c->send_calls++;
+    c->send_us += us;
+  }
+
+  if (s) {
+    ConnStats &x = s[co::scheduler_id()].st;
+    if (in) {
+      atomic_add(&x.bytes_in, n);
+      atomic_inc(&x.recv_calls);
+      atomic_add(&x.recv_us, us);
+    } else {
+      atomic_add(&x.bytes_out, n);
+      atomic_inc(&x.send_calls);
+      atomic_add(&x.send_us, us);
+    }
+  }
+}
+
+// run an IO call, and count it if counters are enabled
+template <typename R, typename F>
+inline R counted(ConnStats *c, ServerTraffic *s, bool in, F &&f) {
+  if (!c)
+    return f();
+  const int64 t = now::us();
+  const R r = f();
+  add_traffic(c, s, in, (int64)r, now::us() - t);
+  return r;
+}
+
 class Conn {
 public:
-  Conn() = default;
-  virtual ~Conn() = default;
+  Conn() : st(FLG_tcp_conn_stats ? new ConnStats() : 0), srv(0) {}
+  virtual ~Conn() { delete st; }
 
   virtual int recv(void *buf, int n, int ms) = 0;
   virtual int recvn(void *buf, int n, int ms) = 0;
   virtual int send(const void *buf, int n, int ms) = 0;
+  virtual int recvv(const co::iovec *iov, int n, int ms) = 0;
+  virtual int sendv(const co::iovec *iov, int n, int ms) = 0;
+#ifndef _WIN32
+  virtual int64 sendfile(int file_fd, int64 off, int64 n, int ms) = 0;
+  virtual int64 splice(int sock, int64 n, int ms) = 0;
+#endif
 
   virtual int close(int ms) = 0;
   virtual int reset(int ms) = 0;
 
   virtual int socket() = 0;
   virtual const char *strerror() = 0;
+
+  ConnStats *st;     // NULL if FLG_tcp_conn_stats is false
+  ServerTraffic *srv; // counters of the server
 };
 
 class TcpConn : public Conn {
@@ -40,9 +360,31 @@ public:
   }
 
   virtual int send(const void *buf, int n, int ms) {
+#ifndef _WIN32
+    if (FLG_tcp_zerocopy_min > 0 && n >= FLG_tcp_zerocopy_min)
+      return co::send_zerocopy(_sock, buf, n, ms);
+#endif
     return co::send(_sock, buf, n, ms);
   }
 
+  virtual int recvv(const co::iovec *iov, int n, int ms) {
+    return co::recvv(_sock, iov, n, ms);
+  }
+
+  virtual int sendv(const co::iovec *iov, int n, int ms) {
+    return co::sendv(_sock, iov, n, ms);
+  }
+
+#ifndef _WIN32
+  virtual int64 sendfile(int file_fd, int64 off, int64 n, int ms) {
+    return co::sendfile(_sock, file_fd, off, n, ms);
+  }
+
+  virtual int64 splice(int sock, int64 n, int ms) {
+    return co::splice(_sock, sock, n, ms);
+  }
+#endif
+
   virtual int close(int ms) {
     const int sock = god::swap(&_sock, -1);
     return sock != -1 ? co::close(sock, ms) : 0;
@@ -61,9 +403,10 @@ private:
   int _sock;
 };
 
+// If records are sent by kTLS, plaintext is written to the socket directly.
 class SSLConn : public Conn {
 public:
-  SSLConn(ssl::S *s) : _s(s) {}
+  SSLConn(ssl::S *s) : _s(s), _ktls_send(ssl::ktls_send(s)) {}
   virtual ~SSLConn() { this->close(0); }
 
   virtual int recv(void *buf, int n, int ms) {
@@ -75,9 +418,64 @@ public:
   }
 
   virtual int send(const void *buf, int n, int ms) {
+    if (_ktls_send)
+      return co::send(ssl::get_fd(_s), buf, n, ms);
     return ssl::send(_s, buf, n, ms);
   }
 
+  virtual int recvv(const co::iovec *iov, int n, int ms) {
+    return ssl_recvv(_s, iov, n, ms);
+  }
+
+  virtual int sendv(const co::iovec *iov, int n, int ms) {
+    if (_ktls_send)
+      return co::sendv(ssl::get_fd(_s), iov, n, ms);
+    return ssl_sendv(_s, iov, n, ms);
+  }
+
+#ifndef _WIN32
+  // Without kTLS, data has to be encrypted in user space, copy it through a
+  // buffer.
+  virtual int64 sendfile(int file_fd, int64 off, int64 n, int ms) {
+    if (_ktls_send)
+      return co::sendfile(ssl::get_fd(_s), file_fd, off, n, ms);
+
+    const int64 N = 16 * 1024;
+    char *buf = (char *)::malloc(N);
+    int64 done = 0;
+    while (done < n) {
+      const int64 x = n - done < N ? n - done : N;
+      ssize_t r = ::pread(file_fd, buf, (size_t)x, (off_t)(off + done));
+      if (r <= 0 || ssl::send(_s, buf, (int)r, ms) != (int)r) {
+        if (r != 0)
+          done = -1;
+        break;
+      }
+      done += r;
+    }
+    ::free(buf);
+    return done;
+  }
+
+  virtual int64 splice(int sock, int64 n, int ms) {
+    const int64 N = 16 * 1024;
+    char *buf = (char *)::malloc(N);
+    int64 done = 0;
+    while (done < n) {
+      const int64 x = n - done < N ? n - done : N;
+      int r = ssl::recv(_s, buf, (int)x, ms);
+      if (r <= 0 || co::send(sock, buf, r, ms) != r) {
+        if (r != 0)
+          done = -1;
+        break;
+      }
+      done += r;
+    }
+    ::free(buf);
+    return done;
+  }
+#endif
+
   virtual int close(int ms) {
     ssl::S *s = god::swap(&_s, nullptr);
     if (s) {
@@ -107,6 +505,7 @@ public:
 
 private:
   ssl::S *_s;
+  bool _ktls_send;
 };
 
 Connection::Connection(int sock) { _p = new TcpConn(sock); }
@@ -116,16 +515,48 @@ Connection::Connection(void *s) { _p = new SSLConn((ssl::S *)s); }
 int Connection::socket() const { return ((Conn *)_p)->socket(); }
 
 int Connection::recv(void *buf, int n, int ms) {
-  return ((Conn *)_p)->recv(buf, n, ms);
+  Conn *c = (Conn *)_p;
+  return counted<int>(c->st, c->srv, true,
+                      [&]() { return c->recv(buf, n, ms); });
 }
 
 int Connection::recvn(void *buf, int n, int ms) {
-  return ((Conn *)_p)->recvn(buf, n, ms);
+  Conn *c = (Conn *)_p;
+  return counted<int>(c->st, c->srv, true,
+                      [&]() { return c->recvn(buf, n, ms); });
 }
 
 int Connection::send(const void *buf, int n, int ms) {
-  return ((Conn *)_p)->send(buf, n, ms);
+  Conn *c = (Conn *)_p;
+  return counted<int>(c->st, c->srv, false,
+                      [&]() { return c->send(buf, n, ms); });
+}
+
+int Connection::recvv(const co::iovec *iov, int n, int ms) {
+  Conn *c = (Conn *)_p;
+  return counted<int>(c->st, c->srv, true,
+                      [&]() { return c->recvv(iov, n, ms); });
+}
+
+int Connection::sendv(const co::iovec *iov, int n, int ms) {
+  Conn *c = (Conn *)_p;
+  return counted<int>(c->st, c->srv, false,
+                      [&]() { return c->sendv(iov, n, ms); });
+}
+
+#ifndef _WIN32
+int64 Connection::sendfile(int file_fd, int64 off, int64 n, int ms) {
+  Conn *c = (Conn *)_p;
+  return counted<int64>(c->st, c->srv, false,
+                        [&]() { return c->sendfile(file_fd, off, n, ms); });
+}
+
+int64 Connection::splice(int sock, int64 n, int ms) {
+  Conn *c = (Conn *)_p;
+  return counted<int64>(c->st, c->srv, true,
+                        [&]() { return c->splice(sock, n, ms); });
 }
+#endif
 
 int Connection::close(int ms) {
   Conn *p = (Conn *)god::swap(&_p, nullptr);
@@ -149,17 +580,28 @@ int Connection::reset(int ms) {
 
 const char *Connection::strerror() const { return ((Conn *)_p)->strerror(); }
 
+ConnStats Connection::stats() const {
+  Conn *c = (Conn *)_p;
+  ConnStats st;
+  memset(&st, 0, sizeof(st));
+  if (c && c->st)
+    st = *c->st;
+  return st;
+}
+
 class ServerImpl {
 public:
   ServerImpl()
-      : _fd((sock_t)-1), _connfd((sock_t)-1), _ssl_ctx(0), _status(0) {}
+      : _ssl_ctx(0), _status(0), _nloop(0), _overload(ov_reject), _active(0),
+        _rejected(0), _total(0), _win_ms(0), _win_n(0), _traffic(0) {}
   ~ServerImpl() {
-    if (_fd != (sock_t)-1)
+    if (atomic_get(&_nloop) != 0)
       this->exit();
     if (_ssl_ctx) {
       ssl::free_ctx(_ssl_ctx);
       _ssl_ctx = 0;
     }
+    delete[] _traffic;
   }
 
   void on_connection(std::function<void(Connection)> &&cb) {
@@ -170,32 +612,64 @@ public:
 
   void exit();
 
+  Server::Stats stats() const {
+    Server::Stats st;
+    st.active = atomic_get((uint32 *)&_active);
+    st.rejected = atomic_get((uint64 *)&_rejected);
+    st.total = atomic_get((uint64 *)&_total);
+    memset(&st.traffic, 0, sizeof(st.traffic));
+    for (size_t i = 0; _traffic && i < co::scheduler_num(); ++i) {
+      ConnStats &x = _traffic[i].st;
+      st.traffic.bytes_in += atomic_get(&x.bytes_in);
+      st.traffic.bytes_out += atomic_get(&x.bytes_out);
+      st.traffic.recv_calls += atomic_get(&x.recv_calls);
+      st.traffic.send_calls += atomic_get(&x.send_calls);
+      st.traffic.recv_us += atomic_get(&x.recv_us);
+      st.traffic.send_us += atomic_get(&x.send_us);
+    }
+    return st;
+  }
+
 private:
+  enum { ov_reject = 0, ov_delay = 1, ov_pause = 2 };
+
+  bool overloaded() const;
+  void take_token();
+  void wait_for_load(sock_t &fd, bool reuseport);
+
   void loop();
+  void loop_reuseport();
   void stop();
+  sock_t listen_socket(bool reuseport);
+  sock_t unix_listen_socket();
+  void remove_unix_path();
+  void accept_loop(sock_t &fd, bool reuseport);
   void on_tcp_connection(sock_t sock);
   void on_ssl_connection(sock_t sock);
 
 private:
   fastring _ip;
   uint16 _port;
-  sock_t _fd;
-  sock_t _connfd;
   std::function<void(Connection)> _conn_cb;
   std::function<void(sock_t)> _on_sock;
   void *_ssl_ctx;
   int _status;
-  int _addrlen;
-  union {
-    struct sockaddr_in v4;
-    struct sockaddr_in6 v6;
-  } _addr;
+  uint32 _nloop; // number of running accept loops
+  int _overload;  // what to do when the server is overloaded
+  uint32 _active; // connections being served
+  uint64 _rejected;
+  uint64 _total;
+  int64 _win_ms;  // start of the current window of the rate limiter
+  uint32 _win_n;  // connections accepted in the current window
+  ServerTraffic *_traffic; // for each scheduler, NULL if stats are disabled
 };
 
 void ServerImpl::start(const char *ip, int port, const char *key,
                        const char *ca) {
   CHECK(_conn_cb != NULL) << "connection callback not set..";
   _ip = (ip && *ip) ? ip : "0.0.0.0";
+  if (FLG_tcp_conn_stats && !_traffic)
+    _traffic = new ServerTraffic[co::scheduler_num()]();
   _port = (uint16)port;
 
   if (key && *key && ca && *ca) {
@@ -215,14 +689,58 @@ void ServerImpl::start(const char *ip, int port, const char *key,
     r = ssl::check_private_key(_ssl_ctx);
     CHECK_EQ(r, 1) << "ssl check private key error: " << ssl::strerror();
 
+    r = ssl::set_session_cache(_ssl_ctx, FLG_ssl_session_cache,
+                               FLG_ssl_session_timeout);
+    CHECK_EQ(r, 1) << "ssl set session cache error: " << ssl::strerror();
+
+    r = ssl::enable_session_tickets(_ssl_ctx, FLG_ssl_ticket_rotate);
+    CHECK_EQ(r, 1) << "ssl enable session tickets error: " << ssl::strerror();
+
+    if (FLG_ssl_ktls && ssl::enable_ktls(_ssl_ctx) != 1)
+      WLOG << "kTLS is not supported by openssl, FLG_ssl_ktls ignored";
+
     _on_sock =
         std::bind(&ServerImpl::on_ssl_connection, this, std::placeholders::_1);
-    go(&ServerImpl::loop, this);
   } else {
     _on_sock =
         std::bind(&ServerImpl::on_tcp_connection, this, std::placeholders::_1);
+  }
+
+  if (FLG_tcp_overload == "delay") {
+    _overload = ov_delay;
+  } else if (FLG_tcp_overload == "pause") {
+    _overload = ov_pause;
+  } else {
+    if (FLG_tcp_overload != "reject")
+      WLOG << "invalid tcp_overload: " << FLG_tcp_overload << ", use reject";
+    _overload = ov_reject;
+  }
+
+#ifndef _WIN32
+  if (FLG_tcp_reuseport && is_unix(_ip.c_str())) {
+    WLOG << "SO_REUSEPORT is not supported by unix domain sockets, use a "
+            "single accept loop..";
+    _nloop = 1;
     go(&ServerImpl::loop, this);
+    return;
   }
+#endif
+
+#ifdef SO_REUSEPORT
+  if (FLG_tcp_reuseport) {
+    auto &scheds = co::all_schedulers();
+    _nloop = (uint32)scheds.size();
+    for (auto &s : scheds)
+      s->go(&ServerImpl::loop_reuseport, this);
+    return;
+  }
+#else
+  if (FLG_tcp_reuseport)
+    WLOG << "SO_REUSEPORT is not supported, use a single accept loop..";
+#endif
+
+  _nloop = 1;
+  go(&ServerImpl::loop, this);
 }
 
 void ServerImpl::exit() {
@@ -240,13 +758,155 @@ void ServerImpl::exit() {
     sleep::ms(1);
 }
 
+// Connect to the server to wake up the accept loops. With SO_REUSEPORT, the
+// kernel picks a listening socket for each connection, and a socket closed
+// leaves the group, so we connect until all the accept loops have stopped.
+// A byte is sent, as the connection is not accepted before data arrives with
+// TCP_DEFER_ACCEPT.
 void ServerImpl::stop() {
   const char *ip =
       (_ip == "0.0.0.0" || _ip == "::") ? "127.0.0.1" : _ip.c_str();
-  tcp::Client c(ip, _port);
-  c.connect(-1);
+  while (atomic_get(&_nloop) != 0) {
+    tcp::Client c(ip, _port);
+    c.connect(-1, "x", 1);
+    if (atomic_get(&_nloop) != 0)
+      co::sleep(1);
+  }
+}
+
+// Return the listening socket, or -1 on error. The server is started only if
+// the first call succeeded, see loop(). A later call to resume the server in
+// pause mode may fail, e.g. the port was taken by another process, it will be
+// retried then.
+sock_t ServerImpl::listen_socket(bool reuseport) {
+#ifndef _WIN32
+  if (is_unix(_ip.c_str()))
+    return this->unix_listen_socket();
+#endif
+
+  fastring port = str::from(_port);
+  struct addrinfo *info = 0;
+  sock_t fd = (sock_t)-1;
+  int r = getaddrinfo(_ip.c_str(), port.c_str(), NULL, &info);
+  if (r != 0 || info == NULL)
+    goto addr_err;
+
+  fd = co::tcp_socket(info->ai_family);
+  if (fd == (sock_t)-1)
+    goto socket_err;
+  co::set_reuseaddr(fd);
+
+#ifdef SO_REUSEPORT
+  if (reuseport) {
+    int on = 1;
+    r = co::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    if (r != 0)
+      goto reuseport_err;
+  }
+#else
+  (void)reuseport;
+#endif
+
+  // turn off IPV6_V6ONLY
+  if (info->ai_family == AF_INET6) {
+    int on = 0;
+    co::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+  }
+
+  r = co::bind(fd, info->ai_addr, (int)info->ai_addrlen);
+  if (r != 0)
+    goto bind_err;
+
+#ifdef TCP_FASTOPEN
+  if (FLG_tcp_fastopen > 0) {
+    int v = FLG_tcp_fastopen;
+    r = co::setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &v, sizeof(v));
+    if (r != 0)
+      WLOG << "set TCP_FASTOPEN error: " << co::strerror();
+  }
+#endif
+
+#ifdef TCP_DEFER_ACCEPT
+  if (FLG_tcp_defer_accept > 0) {
+    int v = FLG_tcp_defer_accept;
+    r = co::setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &v, sizeof(v));
+    if (r != 0)
+      WLOG << "set TCP_DEFER_ACCEPT error: " << co::strerror();
+  }
+#endif
+
+  r = co::listen(fd, 1024);
+  if (r != 0)
+    goto listen_err;
+
+  freeaddrinfo(info);
+  return fd;
+
+addr_err:
+  ELOG << "invalid ip address: " << _ip << ':' << _port;
+  goto err_end;
+socket_err:
+  ELOG << "create socket error: " << co::strerror();
+  goto err_end;
+reuseport_err:
+  ELOG << "set SO_REUSEPORT error: " << co::strerror();
+  goto err_end;
+bind_err:
+  ELOG << "bind " << _ip << ':' << _port << " failed: " << co::strerror();
+  goto err_end;
+listen_err:
+  ELOG << "listen error: " << co::strerror();
+  goto err_end;
+err_end:
+  if (fd != (sock_t)-1)
+    co::close(fd);
+  if (info)
+    freeaddrinfo(info);
+  return (sock_t)-1;
+}
+
+#ifndef _WIN32
+// A socket file left by a previous run is removed before bind(), or bind()
+// fails with EADDRINUSE.
+sock_t ServerImpl::unix_listen_socket() {
+  struct sockaddr_un addr;
+  const int len = unix_addr(_ip.c_str(), &addr);
+  if (len <= 0) {
+    ELOG << "invalid unix socket path: " << _ip;
+    return (sock_t)-1;
+  }
+
+  sock_t fd = co::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == (sock_t)-1) {
+    ELOG << "create socket error: " << co::strerror();
+    return (sock_t)-1;
+  }
+  this->remove_unix_path();
+
+  if (co::bind(fd, &addr, len) != 0) {
+    ELOG << "bind " << _ip << " failed: " << co::strerror();
+    co::close(fd);
+    return (sock_t)-1;
+  }
+
+  if (co::listen(fd, 1024) != 0) {
+    ELOG << "listen error: " << co::strerror();
+    co::close(fd);
+    return (sock_t)-1;
+  }
+  return fd;
 }
 
+void ServerImpl::remove_unix_path() {
+  if (is_unix(_ip.c_str()) && _ip.size() > 5 && _ip[5] != '@')
+    ::unlink(_ip.c_str() + 5);
+}
+
+#else
+sock_t ServerImpl::unix_listen_socket() { return (sock_t)-1; }
+void ServerImpl::remove_unix_path() {}
+#endif
+
 /**
  * the server loop
  *   - It listens on a port and waits for connections.
@@ -254,80 +914,194 @@ void ServerImpl::stop() {
  *     the connection callback to handle the connection.
  */
 void ServerImpl::loop() {
-  do {
-    fastring port = str::from(_port);
-    struct addrinfo *info = 0;
-    int r = getaddrinfo(_ip.c_str(), port.c_str(), NULL, &info);
-    CHECK_EQ(r, 0) << "invalid ip address: " << _ip << ':' << _port;
-    CHECK(info != NULL);
-
-    _fd = co::tcp_socket(info->ai_family);
-    CHECK_NE(_fd, (sock_t)-1) << "create socket error: " << co::strerror();
-    co::set_reuseaddr(_fd);
-
-    // turn off IPV6_V6ONLY
-    if (info->ai_family == AF_INET6) {
-      int on = 0;
-      co::setsockopt(_fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
-    }
+  sock_t fd = this->listen_socket(false);
+  CHECK_NE(fd, (sock_t)-1) << "server start failed: " << _ip << ':' << _port;
+  LOG << "server start: " << _ip << ':' << _port;
+  this->accept_loop(fd, false);
+  LOG << "server stopped: " << _ip << ':' << _port;
+  if (fd != (sock_t)-1)
+    co::close(fd);
+  this->remove_unix_path();
+  atomic_swap(&_nloop, 0);
+  atomic_swap(&_status, 2);
+}
 
-    r = co::bind(_fd, info->ai_addr, (int)info->ai_addrlen);
-    CHECK_EQ(r, 0) << "bind " << _ip << ':' << _port
-                   << " failed: " << co::strerror();
+/**
+ * the server loop in SO_REUSEPORT mode
+ *   - It runs in each scheduler, with its own listening socket.
+ *   - Connections accepted are handled in the same scheduler, no cross-thread
+ *     handoff is needed.
+ */
+void ServerImpl::loop_reuseport() {
+  sock_t fd = this->listen_socket(true);
+  CHECK_NE(fd, (sock_t)-1) << "server start failed: " << _ip << ':' << _port;
+  LOG << "server start: " << _ip << ':' << _port
+      << ", reuseport, scheduler: " << co::scheduler_id();
+  this->accept_loop(fd, true);
+  if (fd != (sock_t)-1)
+    co::close(fd);
+  if (atomic_dec(&_nloop) == 0) {
+    LOG << "server stopped: " << _ip << ':' << _port;
+    atomic_swap(&_status, 2);
+  }
+}
 
-    r = co::listen(_fd, 1024);
-    CHECK_EQ(r, 0) << "listen error: " << co::strerror();
+// Get the scheduler for the CPU that handled packets of the connection. The
+// CPU id is mapped to a scheduler by modulo, it works best if the number of
+// schedulers equals the number of CPUs.
+static co::Scheduler *incoming_cpu_scheduler(sock_t fd) {
+#ifdef SO_INCOMING_CPU
+  int cpu = -1;
+  int len = sizeof(cpu);
+  if (co::getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+      cpu >= 0) {
+    auto &scheds = co::all_schedulers();
+    return scheds[cpu % scheds.size()];
+  }
+#else
+  (void)fd;
+#endif
+  return co::next_scheduler();
+}
 
-    freeaddrinfo(info);
-  } while (0);
+// Check whether the server reaches the limit of concurrent connections or
+// accept rate. The rate limiter counts connections in windows of 1 second.
+bool ServerImpl::overloaded() const {
+  if (FLG_tcp_max_conns > 0 &&
+      atomic_get((uint32 *)&_active) >= (uint32)FLG_tcp_max_conns) {
+    return true;
+  }
+  if (FLG_tcp_max_accept_rate > 0) {
+    const int64 now_ms = now::ms();
+    return now_ms - atomic_get((int64 *)&_win_ms) < 1000 &&
+           atomic_get((uint32 *)&_win_n) >= (uint32)FLG_tcp_max_accept_rate;
+  }
+  return false;
+}
+
+void ServerImpl::take_token() {
+  if (FLG_tcp_max_accept_rate > 0) {
+    const int64 now_ms = now::ms();
+    const int64 w = atomic_get(&_win_ms);
+    if (now_ms - w >= 1000 && atomic_compare_swap(&_win_ms, w, now_ms) == w)
+      atomic_swap(&_win_n, 0);
+    atomic_inc(&_win_n);
+  }
+}
+
+// In delay mode, connections wait in the backlog of the listening socket
+// until the load goes down. In pause mode, the listening socket is closed,
+// so new connections are refused by the system, and it will be opened again
+// when the load goes down. If it fails to listen again, it will retry every
+// second, until it succeeds or the server is stopped.
+void ServerImpl::wait_for_load(sock_t &fd, bool reuseport) {
+  if (_overload == ov_pause && fd != (sock_t)-1) {
+    WLOG << "server " << _ip << ':' << _port << " overloaded, pause..";
+    co::close(fd);
+    fd = (sock_t)-1;
+  }
+
+  while (this->overloaded() && _status != 1)
+    co::sleep(1);
+
+  while (fd == (sock_t)-1 && _status != 1) {
+    fd = this->listen_socket(reuseport);
+    if (fd != (sock_t)-1) {
+      LOG << "server " << _ip << ':' << _port << " resume..";
+      break;
+    }
+    ELOG << "server " << _ip << ':' << _port << " resume failed, retry later..";
+    co::sleep(1000);
+  }
+}
+
+void ServerImpl::accept_loop(sock_t &fd, bool reuseport) {
+  union {
+    struct sockaddr_in v4;
+    struct sockaddr_in6 v6;
+  } addr;
+  int addrlen;
+  sock_t connfd;
 
-  LOG << "server start: " << _ip << ':' << _port;
   while (true) {
-    _addrlen = sizeof(_addr);
-    _connfd = co::accept(_fd, &_addr, &_addrlen);
+    if (unlikely(_overload != ov_reject && this->overloaded())) {
+      this->wait_for_load(fd, reuseport);
+      if (fd == (sock_t)-1)
+        break;
+    }
+
+    addrlen = sizeof(addr);
+    connfd = co::accept(fd, &addr, &addrlen);
 
     if (unlikely(_status == 1)) {
-      co::close(_connfd);
+      co::close(connfd);
       break;
     }
 
-    if (unlikely(_connfd == (sock_t)-1)) {
+    if (unlikely(connfd == (sock_t)-1)) {
       WLOG << "server " << _ip << ':' << _port
            << " accept error: " << co::strerror();
       continue;
     }
 
+    if (unlikely(_overload == ov_reject && this->overloaded())) {
+      DLOG << "server " << _ip << ':' << _port
+           << " overloaded, reset connection: "
+           << co::to_string(&addr, addrlen);
+      co::reset_tcp_socket(connfd);
+      atomic_inc(&_rejected);
+      continue;
+    }
+
+    this->take_token();
+    atomic_inc(&_active);
+    atomic_inc(&_total);
+
     DLOG << "server " << _ip << ':' << _port
-         << " accept new connection: " << co::to_string(&_addr, _addrlen)
-         << ", connfd: " << _connfd;
-    go(&_on_sock, _connfd);
+         << " accept new connection: " << co::to_string(&addr, addrlen)
+         << ", connfd: " << connfd;
+    if (reuseport) {
+      co::scheduler()->go(&_on_sock, connfd);
+    } else if (FLG_tcp_incoming_cpu) {
+      incoming_cpu_scheduler(connfd)->go(&_on_sock, connfd);
+    } else {
+      go(&_on_sock, connfd);
+    }
   }
-
-  LOG << "server stopped: " << _ip << ':' << _port;
-  co::close(_fd);
-  _fd = (sock_t)-1;
-  atomic_swap(&_status, 2);
 }
 
 void ServerImpl::on_tcp_connection(sock_t fd) {
   co::set_tcp_keepalive(fd);
   co::set_tcp_nodelay(fd);
-  _conn_cb(tcp::Connection((int)fd));
+  tcp::Connection conn((int)fd);
+  ((Conn *)conn._p)->srv = _traffic;
+  _conn_cb(std::move(conn));
+  atomic_dec(&_active);
 }
 
 void ServerImpl::on_ssl_connection(sock_t fd) {
   co::set_tcp_keepalive(fd);
   co::set_tcp_nodelay(fd);
 
+  fastring err;
   ssl::S *s = ssl::new_ssl((ssl::C *)_ssl_ctx);
   if (s == NULL)
     goto new_ssl_err;
   if (ssl::set_fd(s, (int)fd) != 1)
     goto set_fd_err;
-  if (ssl::accept(s, FLG_ssl_handshake_timeout) <= 0)
+  if (FLG_ssl_handshake_threads > 0) {
+    if (handshake_pool()->accept(s, FLG_ssl_handshake_timeout, &err) <= 0)
+      goto accept_err;
+  } else if (ssl::accept(s, FLG_ssl_handshake_timeout) <= 0) {
     goto accept_err;
+  }
 
-  _conn_cb(tcp::Connection((void *)s));
+  do {
+    tcp::Connection conn((void *)s);
+    ((Conn *)conn._p)->srv = _traffic;
+    _conn_cb(std::move(conn));
+  } while (0);
+  atomic_dec(&_active);
   return;
 
 new_ssl_err:
@@ -337,12 +1111,14 @@ set_fd_err:
   ELOG << "ssl set fd " << fd << " failed: " << ssl::strerror(s);
   goto err_end;
 accept_err:
-  ELOG << "ssl accept failed: " << ssl::strerror(s);
+  ELOG << "ssl accept failed: "
+       << (err.empty() ? ssl::strerror(s) : err.c_str());
   goto err_end;
 err_end:
   if (s)
     ssl::free_ssl(s);
   co::close(fd, 1000);
+  atomic_dec(&_active);
   return;
 }
 
@@ -365,8 +1141,11 @@ void Server::start(const char *ip, int port, const char *key, const char *ca) {
 
 void Server::exit() { ((ServerImpl *)_p)->exit(); }
 
+Server::Stats Server::stats() const { return ((ServerImpl *)_p)->stats(); }
+
 Client::Client(const char *ip, int port, bool use_ssl)
-    : _port((uint16)port), _use_ssl(use_ssl), _fd(-1) {
+    : _port((uint16)port), _use_ssl(use_ssl), _fd(-1),
+      _st(FLG_tcp_conn_stats ? new ConnStats() : 0) {
   if (!ip || !*ip)
     ip = "127.0.0.1";
   const size_t n = strlen(ip) + 1;
@@ -374,74 +1153,151 @@ Client::Client(const char *ip, int port, bool use_ssl)
     _ip = (char *)malloc(n);
     memcpy(_ip, ip, n);
   } else {
-    const int h = sizeof(void *) * 2;
+    const int h = sizeof(void *);
     _ip = ((char *)malloc(h + n)) + h;
     memcpy(_ip, ip, n);
-    _s[-1] = _s[-2] = 0;
+    _s[-1] = 0;
   }
 }
 
 Client::~Client() {
   this->close();
   if (_ip) {
-    free(!_use_ssl ? _ip : (_ip - sizeof(void *) * 2));
+    free(!_use_ssl ? _ip : (_ip - sizeof(void *)));
     _ip = 0;
   }
+  delete _st;
 }
 
 int Client::recv(void *buf, int n, int ms) {
-  if (!_use_ssl)
-    return co::recv(_fd, buf, n, ms);
-  return ssl::recv(_s[-1], buf, n, ms);
+  return counted<int>(_st, 0, true, [&]() {
+    if (!_use_ssl)
+      return co::recv(_fd, buf, n, ms);
+    return ssl::recv(_s[-1], buf, n, ms);
+  });
 }
 
 int Client::recvn(void *buf, int n, int ms) {
-  if (!_use_ssl)
-    return co::recvn(_fd, buf, n, ms);
-  return ssl::recvn(_s[-1], buf, n, ms);
+  return counted<int>(_st, 0, true, [&]() {
+    if (!_use_ssl)
+      return co::recvn(_fd, buf, n, ms);
+    return ssl::recvn(_s[-1], buf, n, ms);
+  });
 }
 
 int Client::send(const void *buf, int n, int ms) {
-  if (!_use_ssl)
-    return co::send(_fd, buf, n, ms);
-  return ssl::send(_s[-1], buf, n, ms);
+  return counted<int>(_st, 0, false, [&]() {
+    if (!_use_ssl) {
+#ifndef _WIN32
+      if (FLG_tcp_zerocopy_min > 0 && n >= FLG_tcp_zerocopy_min)
+        return co::send_zerocopy(_fd, buf, n, ms);
+#endif
+      return co::send(_fd, buf, n, ms);
+    }
+    return ssl::send(_s[-1], buf, n, ms);
+  });
+}
+
+int Client::recvv(const co::iovec *iov, int n, int ms) {
+  return counted<int>(_st, 0, true, [&]() {
+    if (!_use_ssl)
+      return co::recvv(_fd, iov, n, ms);
+    return ssl_recvv(_s[-1], iov, n, ms);
+  });
+}
+
+int Client::sendv(const co::iovec *iov, int n, int ms) {
+  return counted<int>(_st, 0, false, [&]() {
+    if (!_use_ssl)
+      return co::sendv(_fd, iov, n, ms);
+    return ssl_sendv(_s[-1], iov, n, ms);
+  });
+}
+
+ConnStats Client::stats() const {
+  ConnStats st;
+  memset(&st, 0, sizeof(st));
+  if (_st)
+    st = *_st;
+  return st;
 }
 
-bool Client::connect(int ms) {
+bool Client::connect(int ms) { return this->connect(ms, NULL, 0); }
+
+// Without SSL, data is sent with the SYN by co::connect_fastopen(). With SSL,
+// it is sent after the handshake.
+bool Client::connect(int ms, const void *buf, int n) {
   if (this->connected())
-    return true;
+    return n <= 0 || this->send(buf, n, ms) == n;
 
   fastring port = str::from(_port);
   struct addrinfo *info = 0;
-  int r = getaddrinfo(_ip, port.c_str(), NULL, &info);
-  if (r != 0)
-    goto err_end;
+  const void *addr = 0;
+  int addrlen = 0, family = AF_UNSPEC, r;
+  bool tfo = n > 0 && !_use_ssl;
+#ifndef _WIN32
+  struct sockaddr_un ua;
+  if (is_unix(_ip)) {
+    addrlen = unix_addr(_ip, &ua);
+    if (addrlen == 0) {
+      ELOG << "invalid unix socket path: " << _ip;
+      goto err_end;
+    }
+    addr = &ua;
+    family = AF_UNIX;
+    tfo = false;
+  }
+#endif
+
+  if (family == AF_UNSPEC) {
+    r = getaddrinfo(_ip, port.c_str(), NULL, &info);
+    if (r != 0)
+      goto err_end;
+    CHECK_NOTNULL(info);
+    addr = info->ai_addr;
+    addrlen = (int)info->ai_addrlen;
+    family = info->ai_family;
+  }
 
-  CHECK_NOTNULL(info);
-  _fd = (int)co::tcp_socket(info->ai_family);
+  _fd = (int)(family == AF_UNIX ? co::socket(AF_UNIX, SOCK_STREAM, 0)
+                                : co::tcp_socket(family));
   if (_fd == -1) {
     ELOG << "connect to " << _ip << ':' << _port
          << " failed: " << co::strerror();
     goto err_end;
   }
 
-  r = co::connect(_fd, info->ai_addr, (int)info->ai_addrlen, ms);
+  if (tfo) {
+    r = co::connect_fastopen(_fd, addr, addrlen, buf, n, ms);
+    r = r == n ? 0 : -1;
+  } else {
+    r = co::connect(_fd, addr, addrlen, ms);
+  }
   if (r != 0) {
     ELOG << "connect to " << _ip << ':' << _port
          << " failed: " << co::strerror();
     goto err_end;
   }
 
-  co::set_tcp_nodelay(_fd);
+  if (family != AF_UNIX)
+    co::set_tcp_nodelay(_fd);
   if (_use_ssl) {
-    if ((_s[-2] = ssl::new_client_ctx()) == NULL)
+    ssl::C *c = ssl_clients()->ctx();
+    if (c == NULL)
       goto new_ctx_err;
-    if ((_s[-1] = ssl::new_ssl(_s[-2])) == NULL)
+    if ((_s[-1] = ssl::new_ssl(c)) == NULL)
       goto new_ssl_err;
     if (ssl::set_fd(_s[-1], _fd) != 1)
       goto set_fd_err;
+    if (FLG_ssl_session_reuse)
+      ssl_clients()->resume(endpoint(_ip, _port), _s[-1]);
     if (ssl::connect(_s[-1], ms) != 1)
       goto connect_err;
+    if (n > 0 && ssl::send(_s[-1], buf, n, ms) != n)
+      goto send_err;
+  } else if (n > 0 && !tfo && co::send(_fd, buf, n, ms) != n) {
+    ELOG << "send to " << _ip << ':' << _port << " failed: " << co::strerror();
+    goto err_end;
   }
 
   if (info)
@@ -460,6 +1316,10 @@ set_fd_err:
 connect_err:
   ELOG << "ssl connect failed: " << ssl::strerror(_s[-1]);
   goto err_end;
+send_err:
+  ELOG << "ssl send to " << _ip << ':' << _port
+       << " failed: " << ssl::strerror(_s[-1]);
+  goto err_end;
 err_end:
   this->disconnect();
   if (info)
@@ -469,15 +1329,11 @@ err_end:
 
 void Client::disconnect() {
   if (_fd != -1) {
-    if (_use_ssl) {
-      if (_s[-1]) {
-        ssl::free_ssl(_s[-1]);
-        _s[-1] = 0;
-      }
-      if (_s[-2]) {
-        ssl::free_ctx(_s[-2]);
-        _s[-2] = 0;
-      }
+    if (_use_ssl && _s[-1]) {
+      if (FLG_ssl_session_reuse)
+        ssl_clients()->save(endpoint(_ip, _port), _s[-1]);
+      ssl::free_ssl(_s[-1]);
+      _s[-1] = 0;
     }
     co::close(_fd);
     _fd = -1;
@@ -490,4 +1346,528 @@ const char *Client::strerror() const {
   return ssl::strerror(_s[-1]);
 }
 
+Reader::Reader(Connection &conn, size_t cap)
+    : _c(&conn), _client(false), _buf(0), _init_cap(cap ? cap : 4096),
+      _cap(0), _r(0), _w(0), _v(0), _vn(0) {}
+
+Reader::Reader(Client &cli, size_t cap)
+    : _c(&cli), _client(true), _buf(0), _init_cap(cap ? cap : 4096), _cap(0),
+      _r(0), _w(0), _v(0), _vn(0) {}
+
+Reader::~Reader() { ::free(_buf); }
+
+inline int Reader::recv(void *buf, int n, int ms) {
+  return _client ? ((Client *)_c)->recv(buf, n, ms)
+                 : ((Connection *)_c)->recv(buf, n, ms);
+}
+
+inline int Reader::recvn(void *buf, int n, int ms) {
+  return _client ? ((Client *)_c)->recvn(buf, n, ms)
+                 : ((Connection *)_c)->recvn(buf, n, ms);
+}
+
+void Reader::release() {
+  if (_buf && _r == _w) {
+    ::free(_buf);
+    _buf = 0;
+    _cap = _r = _w = _v = _vn = 0;
+  }
+}
+
+// Receive until at least @need bytes are buffered. Each recv takes as much
+// data as the free space of the buffer, so later reads may need no syscall.
+int Reader::fill(size_t need, int ms) {
+  while (_w - _r < need) {
+    if (!_buf) {
+      // receive a single byte before allocating the buffer
+      char c;
+      const int r = this->recv(&c, 1, ms);
+      if (r <= 0)
+        return r;
+      _cap = need > _init_cap ? need : _init_cap;
+      _buf = (char *)::malloc(_cap);
+      _buf[0] = c;
+      _r = _v = _vn = 0;
+      _w = 1;
+      continue;
+    }
+
+    // move data to the front if the free space at the end is small
+    if (_r > 0 &&
+        (_r == _w || _cap - _r < need || _cap - _w < (_init_cap >> 2))) {
+      memmove(_buf, _buf + _r, _w - _r);
+      _w -= _r;
+      _r = 0;
+    }
+    if (_cap < need || _w == _cap) {
+      size_t cap = _cap * 2;
+      if (cap < need)
+        cap = need;
+      _buf = (char *)::realloc(_buf, cap);
+      _cap = cap;
+    }
+
+    const int r = this->recv(_buf + _w, (int)(_cap - _w), ms);
+    if (r <= 0)
+      return r;
+    _w += r;
+  }
+  return 1;
+}
+
+static const char *find_delim(const char *s, size_t n, const char *d,
+                              size_t dn) {
+  if (dn == 1)
+    return (const char *)memchr(s, *d, n);
+  while (n >= dn) {
+    const char *p = (const char *)memchr(s, *d, n - dn + 1);
+    if (!p)
+      return 0;
+    if (memcmp(p, d, dn) == 0)
+      return p;
+    n -= p - s + 1;
+    s = p + 1;
+  }
+  return 0;
+}
+
+int Reader::read_until(const char *delim, size_t n, size_t max, int ms) {
+  size_t scanned = 0; // bytes scanned without finding the delimiter
+  while (true) {
+    const size_t m = _w - _r;
+    if (m >= n) {
+      const size_t from = scanned >= n ? scanned - n + 1 : 0;
+      const char *b = _buf + _r;
+      const char *p = find_delim(b + from, m - from, delim, n);
+      if (p) {
+        const size_t k = p - b + n;
+        if (k > max)
+          break;
+        _v = _r;
+        _vn = k;
+        _r += k;
+        return (int)k;
+      }
+      scanned = m;
+    }
+
+    if (m >= max)
+      break;
+    const int r = this->fill(m + 1, ms);
+    if (r <= 0)
+      return r;
+  }
+
+  co::set_error(EMSGSIZE);
+  return -1;
+}
+
+int Reader::read_line(size_t max, int ms) {
+  const int r = this->read_until('\n', max, ms);
+  if (r > 0) {
+    --_vn;
+    if (_vn > 0 && _buf[_v + _vn - 1] == '\r')
+      --_vn;
+  }
+  return r;
+}
+
+int Reader::read_exact(size_t n, int ms) {
+  const int r = this->fill(n, ms);
+  if (r <= 0)
+    return r;
+  _v = _r;
+  _vn = n;
+  _r += n;
+  return (int)n;
+}
+
+int Reader::read_exact(void *buf, size_t n, int ms) {
+  const size_t k = _w - _r < n ? _w - _r : n;
+  if (k > 0) {
+    memcpy(buf, _buf + _r, k);
+    _r += k;
+  }
+  if (k == n)
+    return (int)n;
+
+  // receive large data into buf directly
+  const size_t x = n - k;
+  if (x >= _init_cap) {
+    const int r = this->recvn((char *)buf + k, (int)x, ms);
+    return r <= 0 ? r : (int)n;
+  }
+
+  const int r = this->fill(x, ms);
+  if (r <= 0)
+    return r;
+  memcpy((char *)buf + k, _buf + _r, x);
+  _r += x;
+  return (int)n;
+}
+
+int Reader::peek(size_t n, int ms) {
+  const int r = this->fill(n, ms);
+  if (r <= 0)
+    return r;
+  _v = _r;
+  _vn = _w - _r;
+  return (int)_vn;
+}
+
+// state of a host shared by all schedulers
+struct PoolHost {
+  PoolHost(const char *ip, int port, uint32 max_conns)
+      : ip(ip), port(port), sem(max_conns) {}
+  fastring ip;
+  int port;
+  co::Semaphore sem; // limits connections checked out
+};
+
+// The client MUST be the first member, a Client* popped from the pool is
+// converted back to PooledClient* in push().
+struct PooledClient {
+  PooledClient(PoolHost *h, bool use_ssl)
+      : cli(h->ip.c_str(), h->port, use_ssl), host(h), t(0) {}
+  Client cli;
+  PoolHost *host;
+  int64 t; // when it was pushed back, in milliseconds
+};
+
+class ConnPoolImpl {
+public:
+  // idle connections of a host in a scheduler, the oldest ones are in the
+  // front
+  struct Idle {
+    Idle() : h(0) {}
+    PoolHost *h;
+    std::vector<PooledClient *> v;
+  };
+
+  // pad to a cache line, schedulers do not share cache lines with each other
+  struct Local {
+    Local() : hit(0), miss(0), dead(0), evicted(0), failed(0), busy(0), idle(0) {}
+    std::unordered_map<fastring, Idle> m; // host:port -> idle connections
+    uint64 hit;
+    uint64 miss;
+    uint64 dead;
+    uint64 evicted;
+    uint64 failed;
+    int64 busy; // may be negative if connections were pushed elsewhere
+    int64 idle;
+    char _pad[64 - (sizeof(std::unordered_map<fastring, Idle>) + 56) % 64];
+  };
+
+  ConnPoolImpl(uint32 max_conns, uint32 max_idle, uint32 idle_ms,
+               bool use_ssl)
+      : _refn(1), _locals(co::scheduler_num()), _max_conns(max_conns),
+        _max_idle(max_idle), _idle_ms(idle_ms), _use_ssl(use_ssl),
+        _evicting(0), _stopped(0) {}
+
+  ~ConnPoolImpl() {
+    this->clear();
+    for (auto &x : _hosts)
+      delete x.second;
+  }
+
+  void ref() { atomic_inc(&_refn); }
+
+  void unref() {
+    if (atomic_dec(&_refn) == 0)
+      delete this;
+  }
+
+  void on_connect(std::function<bool(Client &)> &&f) {
+    _on_connect = std::move(f);
+  }
+
+  Client *pop(const char *host, int port, int ms);
+  void push(Client *c);
+  void warm_up(const char *host, int port, uint32 n, int ms);
+  ConnPool::Stats stats() const;
+  void stop_evicting();
+
+private:
+  Local &local() { return _locals[co::scheduler_id()]; }
+  Idle &idle(Local &l, const char *host, int port);
+  PooledClient *create(PoolHost *h, int ms);
+  static bool alive(PooledClient *c);
+  void start_evicting();
+  void evict();
+  void clear();
+
+  uint32 _refn; // background coroutines hold a reference
+  std::vector<Local> _locals;
+  std::unordered_map<fastring, PoolHost *> _hosts;
+  ::Mutex _mtx; // for _hosts, _evicting and _stopped
+  std::function<bool(Client &)> _on_connect;
+  uint32 _max_conns;
+  uint32 _max_idle;
+  uint32 _idle_ms;
+  bool _use_ssl;
+  uint32 _evicting; // 1 if coroutines for eviction were created
+  uint32 _stopped;  // 1 if eviction was stopped
+  co::Semaphore _stop;
+  co::WaitGroup _wg;
+};
+
+// Hosts are looked up in the map of the current scheduler, the shared map
+// is locked only the first time a host is used in a scheduler.
+ConnPoolImpl::Idle &ConnPoolImpl::idle(Local &l, const char *host, int port) {
+  fastring key(host);
+  key << ':' << port;
+  Idle &x = l.m[key];
+  if (x.h == 0) {
+    ::MutexGuard g(_mtx);
+    PoolHost *&h = _hosts[key];
+    if (h == 0)
+      h = new PoolHost(host, port, _max_conns);
+    x.h = h;
+  }
+  return x;
+}
+
+PooledClient *ConnPoolImpl::create(PoolHost *h, int ms) {
+  PooledClient *c = new PooledClient(h, _use_ssl);
+  if (c->cli.connect(ms) && (!_on_connect || _on_connect(c->cli)))
+    return c;
+  delete c;
+  return 0;
+}
+
+// A connection is alive if there is nothing to read on it. Data on an idle
+// connection means EOF, or an unexpected message from the peer. Records of
+// the TLS protocol, e.g. session tickets of TLS 1.3, are not messages, and are
+// consumed by openssl in ssl::alive().
+bool ConnPoolImpl::alive(PooledClient *c) {
+  if (c->cli._use_ssl)
+    return c->cli._s[-1] && ssl::alive(c->cli._s[-1]);
+  char x;
+  const int r = (int)CO_RAW_API(recv)(c->cli.socket(), &x, 1, MSG_PEEK);
+  if (r != -1)
+    return false;
+#ifdef _WIN32
+  return co::error() == WSAEWOULDBLOCK;
+#else
+  return errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+}
+
+Client *ConnPoolImpl::pop(const char *host, int port, int ms) {
+  CHECK(co::scheduler_id() >= 0) << "must be called in coroutine..";
+  Local &l = this->local();
+  Idle &x = this->idle(l, host, port);
+  if (_max_conns > 0 && !x.h->sem.acquire((uint32)ms)) {
+    ++l.failed;
+    return 0;
+  }
+
+  while (!x.v.empty()) {
+    PooledClient *c = x.v.back();
+    x.v.pop_back();
+    --l.idle;
+    if (this->alive(c)) {
+      ++l.hit;
+      ++l.busy;
+      return &c->cli;
+    }
+    ++l.dead;
+    delete c;
+  }
+
+  PooledClient *c = this->create(x.h, ms);
+  if (c) {
+    ++l.miss;
+    ++l.busy;
+    return &c->cli;
+  }
+  ++l.failed;
+  if (_max_conns > 0)
+    x.h->sem.release();
+  return 0;
+}
+
+void ConnPoolImpl::push(Client *p) {
+  if (!p)
+    return;
+  CHECK(co::scheduler_id() >= 0) << "must be called in coroutine..";
+  PooledClient *c = (PooledClient *)p;
+  PoolHost *h = c->host;
+  Local &l = this->local();
+  --l.busy;
+  if (_max_conns > 0)
+    h->sem.release();
+
+  if (!c->cli.connected()) {
+    delete c;
+    return;
+  }
+
+  Idle &x = this->idle(l, h->ip.c_str(), h->port);
+  if (x.v.size() >= _max_idle) {
+    delete c;
+    return;
+  }
+  c->t = _idle_ms ? now::ms() : 0;
+  x.v.push_back(c);
+  ++l.idle;
+  if (_idle_ms && !_evicting)
+    this->start_evicting();
+}
+
+void ConnPoolImpl::warm_up(const char *host, int port, uint32 n, int ms) {
+  if (n > _max_idle)
+    n = _max_idle;
+  fastring ip(host);
+  for (auto &s : co::all_schedulers()) {
+    this->ref();
+    s->go([this, ip, port, n, ms]() {
+      Local &l = this->local();
+      Idle &x = this->idle(l, ip.c_str(), port);
+      while (x.v.size() < n) {
+        PooledClient *c = this->create(x.h, ms);
+        if (!c) {
+          ++l.failed;
+          break;
+        }
+        c->t = _idle_ms ? now::ms() : 0;
+        x.v.push_back(c);
+        ++l.idle;
+      }
+      if (_idle_ms && !_evicting)
+        this->start_evicting();
+      this->unref();
+    });
+  }
+}
+
+ConnPool::Stats ConnPoolImpl::stats() const {
+  ConnPool::Stats s;
+  memset(&s, 0, sizeof(s));
+  int64 busy = 0, idle = 0;
+  for (auto &l : _locals) {
+    s.hit += l.hit;
+    s.miss += l.miss;
+    s.dead += l.dead;
+    s.evicted += l.evicted;
+    s.failed += l.failed;
+    busy += l.busy;
+    idle += l.idle;
+  }
+  s.busy = busy > 0 ? (uint32)busy : 0;
+  s.idle = idle > 0 ? (uint32)idle : 0;
+  return s;
+}
+
+// Create a coroutine in each scheduler, which wakes up every once in a
+// while, and closes connections idle for more than _idle_ms.
+void ConnPoolImpl::start_evicting() {
+  ::MutexGuard g(_mtx);
+  if (_stopped || _evicting)
+    return;
+  atomic_set(&_evicting, 1u);
+  const uint32 ms = _idle_ms < 1000 ? _idle_ms : 1000;
+  auto &scheds = co::all_schedulers();
+  _wg.add((uint32)scheds.size());
+  for (auto &s : scheds) {
+    s->go([this, ms]() {
+      while (!_stop.acquire(ms))
+        this->evict();
+      _wg.done();
+    });
+  }
+}
+
+void ConnPoolImpl::stop_evicting() {
+  {
+    ::MutexGuard g(_mtx);
+    _stopped = 1;
+  }
+  if (atomic_get(&_evicting) && !co::is_stopped()) {
+    _stop.release((uint32)_locals.size());
+    _wg.wait();
+  }
+}
+
+void ConnPoolImpl::evict() {
+  const int64 deadline = now::ms() - _idle_ms;
+  Local &l = this->local();
+  std::vector<PooledClient *> v;
+  for (auto &kv : l.m) {
+    auto &x = kv.second.v;
+    size_t n = 0;
+    while (n < x.size() && x[n]->t <= deadline)
+      v.push_back(x[n++]);
+    if (n > 0)
+      x.erase(x.begin(), x.begin() + n);
+  }
+
+  // closing a connection may yield, they are closed after being removed
+  l.idle -= (int64)v.size();
+  l.evicted += v.size();
+  for (auto &c : v)
+    delete c;
+}
+
+// Connections are closed in the schedulers that own them.
+void ConnPoolImpl::clear() {
+  auto f = [](Local &l) {
+    for (auto &kv : l.m) {
+      for (auto &c : kv.second.v)
+        delete c;
+    }
+    l.m.clear();
+  };
+
+  // f is copied into the coroutines, the stack of the calling coroutine may
+  // be swapped out while it is waiting.
+  if (!co::is_stopped()) {
+    auto &scheds = co::all_schedulers();
+    co::WaitGroup wg;
+    wg.add((uint32)scheds.size());
+    for (auto &s : scheds) {
+      s->go([this, f, wg]() {
+        f(this->local());
+        wg.done();
+      });
+    }
+    wg.wait();
+  } else {
+    for (auto &l : _locals)
+      f(l);
+  }
+}
+
+ConnPool::ConnPool(uint32 max_conns, uint32 max_idle, uint32 idle_ms,
+                   bool use_ssl) {
+  _p = new ConnPoolImpl(max_conns, max_idle, idle_ms, use_ssl);
+}
+
+ConnPool::~ConnPool() {
+  auto p = (ConnPoolImpl *)_p;
+  if (p) {
+    p->stop_evicting();
+    p->unref();
+    _p = 0;
+  }
+}
+
+void ConnPool::on_connect(std::function<bool(Client &)> &&f) {
+  ((ConnPoolImpl *)_p)->on_connect(std::move(f));
+}
+
+Client *ConnPool::pop(const char *host, int port, int ms) {
+  return ((ConnPoolImpl *)_p)->pop(host, port, ms);
+}
+
+void ConnPool::push(Client *c) { ((ConnPoolImpl *)_p)->push(c); }
+
+void ConnPool::warm_up(const char *host, int port, uint32 n, int ms) {
+  ((ConnPoolImpl *)_p)->warm_up(host, port, n, ms);
+}
+
+ConnPool::Stats ConnPool::stats() const {
+  return ((ConnPoolImpl *)_p)->stats();
+}
+
 } // namespace tcp
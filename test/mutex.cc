@@ -0,0 +1,48 @@
+#include "co/co.h"
+#include "co/cout.h"
+#include "co/time.h"
+
+DEF_int32(n, 100000, "lock/unlock per coroutine");
+DEF_int32(c, 4, "coroutines per scheduler");
+
+// coroutines on all schedulers contend for a co::Mutex protecting a tiny
+// critical section
+void contend(int nsched) {
+    co::Mutex m;
+    co::WaitGroup wg;
+    auto& s = co::all_schedulers();
+    int64 v = 0;
+    wg.add(nsched * FLG_c);
+
+    Timer t;
+    for (int i = 0; i < nsched; ++i) {
+        for (int k = 0; k < FLG_c; ++k) {
+            s[i]->go([m, wg, &v]() {
+                for (int x = 0; x < FLG_n; ++x) {
+                    co::MutexGuard g(m);
+                    ++v;
+                }
+                wg.done();
+            });
+        }
+    }
+    wg.wait();
+
+    int64 us = t.us();
+    int64 total = (int64)nsched * FLG_c * FLG_n;
+    COUT << "schedulers: " << nsched << ", coroutines: " << nsched * FLG_c
+         << ", ops: " << total << ", done in " << us << " us, avg: "
+         << (us * 1000.0 / total) << " ns" << (v == total ? "" : " (BAD COUNT)");
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+
+    for (int i = 1; i <= co::scheduler_num(); i <<= 1) contend(i);
+    if ((co::scheduler_num() & (co::scheduler_num() - 1)) != 0) {
+        contend(co::scheduler_num());
+    }
+
+    co::exit();
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "co/co.h"
+#include "co/co/parallel.h"
+#include "co/cout.h"
+#include "co/hash.h"
+#include "co/time.h"
+
+DEF_int32(n, 1 << 22, "number of items");
+DEF_int32(grain, 0, "grain size of parallel_for, 0 for auto");
+
+// Hash n items in a single thread and with co::parallel_for/parallel_reduce.
+// Run it with -co_sched_num 1, 2, 4, ... to see how it scales on 1..N cores.
+uint64 work(size_t i) {
+    uint64 h = i;
+    for (int k = 0; k < 16; ++k) h = hash64(&h, sizeof(h));
+    return h;
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+
+    const size_t n = (size_t)FLG_n;
+    const size_t grain = (size_t)FLG_grain;
+    std::vector<uint64> v(n);
+
+    Timer t;
+    for (size_t i = 0; i < n; ++i) v[i] = work(i);
+    int64 serial = t.us();
+    COUT << "serial: " << serial << " us";
+
+    t.restart();
+    co::parallel_for(0, n, grain, [&v](size_t i) { v[i] = work(i); });
+    int64 us = t.us();
+    COUT << "parallel_for, schedulers: " << co::scheduler_num() << ", "
+         << us << " us, speedup: " << (double)serial / us;
+
+    t.restart();
+    uint64 x = 0;
+    for (size_t i = 0; i < n; ++i) x ^= work(i);
+    serial = t.us();
+
+    t.restart();
+    uint64 r = co::parallel_reduce(0, n, grain, (uint64)0,
+        [](size_t i) { return work(i); },
+        [](uint64 a, uint64 b) { return a ^ b; }
+    );
+    us = t.us();
+    COUT << "parallel_reduce, schedulers: " << co::scheduler_num() << ", "
+         << us << " us, speedup: " << (double)serial / us
+         << (r == x ? "" : " (BAD RESULT)");
+
+    co::exit();
+    return 0;
+}
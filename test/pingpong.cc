@@ -0,0 +1,48 @@
+#include "co/co.h"
+#include "co/cout.h"
+#include "co/time.h"
+
+DEF_int32(n, 1000000, "round trips per test");
+
+// ping-pong between two coroutines, on the same scheduler or not
+void pingpong(co::Scheduler* s1, co::Scheduler* s2, const char* name) {
+    co::Chan<int> ping, pong;
+    co::WaitGroup wg;
+    wg.add(2);
+
+    int64 us = 0;
+    s1->go([ping, pong, wg, &us]() {
+        Timer t;
+        int v = 0;
+        for (int i = 0; i < FLG_n; ++i) {
+            ping << i;
+            pong >> v;
+        }
+        us = t.us();
+        wg.done();
+    });
+
+    s2->go([ping, pong, wg]() {
+        int v = 0;
+        for (int i = 0; i < FLG_n; ++i) {
+            ping >> v;
+            pong << v;
+        }
+        wg.done();
+    });
+
+    wg.wait();
+    COUT << name << ": " << FLG_n << " round trips done in " << us << " us, avg: "
+         << (us * 1000.0 / FLG_n) << " ns";
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+
+    auto& s = co::all_schedulers();
+    pingpong(s[0], s[0], "same scheduler");
+    if (s.size() > 1) pingpong(s[0], s[1], "cross scheduler");
+
+    co::exit();
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "co/all.h"
+
+DEF_string(ip, "127.0.0.1", "ip");
+DEF_int32(port, 9989, "port");
+DEF_int32(c, 64, "number of client coroutines");
+DEF_int32(t, 3, "seconds to run");
+DEC_bool(tcp_reuseport);
+DEC_bool(tcp_incoming_cpu);
+
+// Connection-rate benchmark for tcp::Server. Each client coroutine connects,
+// sends a byte, waits for the echo and closes the connection, in a loop.
+// Compare the result with and without -tcp_reuseport or -tcp_incoming_cpu,
+// or try the admission control with -tcp_max_conns, -tcp_max_accept_rate and
+// -tcp_overload.
+void on_connection(tcp::Connection conn) {
+    char c;
+    if (conn.recv(&c, 1, 3000) == 1) conn.send(&c, 1, 3000);
+    conn.close();
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+
+    tcp::Server s;
+    s.on_connection(on_connection);
+    s.start(FLG_ip.c_str(), FLG_port);
+    sleep::ms(32);
+
+    int64 ok = 0, err = 0;
+    bool stop = false;
+    co::WaitGroup wg;
+    wg.add(FLG_c);
+
+    Timer timer;
+    for (int i = 0; i < FLG_c; ++i) {
+        go([wg, &ok, &err, &stop]() {
+            char c = 'x';
+            while (!atomic_get(&stop)) {
+                tcp::Client cli(FLG_ip.c_str(), FLG_port);
+                if (cli.connect(3000) && cli.send(&c, 1, 3000) == 1 &&
+                    cli.recv(&c, 1, 3000) == 1) {
+                    atomic_inc(&ok);
+                } else {
+                    atomic_inc(&err);
+                }
+            }
+            wg.done();
+        });
+    }
+
+    sleep::sec(FLG_t);
+    atomic_swap(&stop, true);
+    wg.wait();
+    int64 us = timer.us();
+
+    COUT << "schedulers: " << co::scheduler_num() << ", reuseport: "
+         << FLG_tcp_reuseport << ", incoming_cpu: " << FLG_tcp_incoming_cpu
+         << ", clients: " << FLG_c << ", connections: "
+         << ok << ", errors: " << err << ", rate: " << (ok * 1000000 / us)
+         << "/s";
+    auto st = s.stats();
+    COUT << "server active: " << st.active << ", total: " << st.total
+         << ", rejected: " << st.rejected;
+
+    s.exit();
+    co::exit();
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include "co/all.h"
+#include <deque>
+#include <memory>
+#include <vector>
+
+DEF_string(m, "echo", "protocol: echo, rpc, http");
+DEF_string(r, "both", "role: server, client or both");
+DEF_string(ip, "127.0.0.1", "server ip");
+DEF_int32(port, 9994, "server port");
+DEF_int32(c, 16, "number of connections");
+DEF_int32(d, 1, "pipeline depth, requests in flight on a connection");
+DEF_int32(rate, 0, "requests per second of all connections, 0 for closed-loop");
+DEF_int32(sec, 5, "seconds to run");
+DEF_int32(size, 64, "size of a request or response body");
+
+// Load generator for the echo, rpc and http servers built on co. It runs a
+// built-in server of the protocol, or a client against it, or both:
+//   loadgen -m echo -c 64 -d 8           # closed-loop, 8 requests in flight
+//   loadgen -m http -c 16 -rate 50000    # fixed rate of 50000 requests/s
+//   loadgen -m rpc -r server -ip 0.0.0.0
+//   loadgen -m rpc -r client -ip <server ip> -c 64
+//
+// In closed-loop mode, a connection sends a new request when a response is
+// received. In fixed-rate mode, requests are sent on schedule, and latency is
+// measured from the time a request was scheduled, not the time it was sent,
+// so a slow server can't hide the requests it delayed. Timers of coroutines
+// are in milliseconds, latencies in fixed-rate mode may be up to 1ms higher.
+// The rpc client is synchronous, the pipeline depth is always 1 for rpc.
+
+// Log-linear histogram of latencies in microseconds. Values are grouped by
+// the highest bit and the next 5 bits, the relative error is about 3%.
+class Histogram {
+  public:
+    enum { kSub = 32, kSize = 60 * kSub };
+
+    Histogram() : _n(0), _sum(0), _max(0), _c(kSize, 0) {}
+
+    void add(int64 us) {
+        const uint64 v = us > 0 ? (uint64)us : 0;
+        ++_c[index(v)];
+        ++_n;
+        _sum += v;
+        if (v > _max) _max = v;
+    }
+
+    void merge(const Histogram& h) {
+        for (int i = 0; i < kSize; ++i) _c[i] += h._c[i];
+        _n += h._n;
+        _sum += h._sum;
+        if (h._max > _max) _max = h._max;
+    }
+
+    // the lower bound of the bucket that holds the p-th percentile
+    uint64 percentile(double p) const {
+        const uint64 target = (uint64)(_n * p / 100);
+        uint64 x = 0;
+        for (int i = 0; i < kSize; ++i) {
+            x += _c[i];
+            if (x > target) return value(i);
+        }
+        return _max;
+    }
+
+    uint64 count() const { return _n; }
+    uint64 mean() const { return _n > 0 ? _sum / _n : 0; }
+    uint64 max() const { return _max; }
+
+  private:
+    static int index(uint64 v) {
+        if (v < kSub) return (int)v;
+        int b = 63;
+        while (!(v >> b)) --b;
+        return (b - 4) * kSub + (int)((v >> (b - 5)) & (kSub - 1));
+    }
+
+    static uint64 value(int i) {
+        if (i < kSub) return (uint64)i;
+        const int b = i / kSub + 4;
+        return (uint64)(kSub + i % kSub) << (b - 5);
+    }
+
+    uint64 _n;
+    uint64 _sum;
+    uint64 _max;
+    std::vector<uint64> _c;
+};
+
+struct Result {
+    Result() : errors(0), bytes(0) {}
+    Histogram h;
+    uint64 errors;
+    uint64 bytes; // bytes of response bodies
+};
+
+// ========================================================================
+// servers
+// ========================================================================
+void on_echo_connection(tcp::Connection conn) {
+    fastring buf(FLG_size, '\0');
+    while (true) {
+        int r = conn.recvn((void*)buf.data(), FLG_size);
+        if (r <= 0 || conn.send(buf.data(), FLG_size) != FLG_size) break;
+    }
+    conn.close();
+}
+
+class EchoService : public rpc::Service {
+  public:
+    virtual const char* name() const { return "Echo"; }
+
+    virtual void process(const Json& req, Json& res) {
+        Json::Value x = req["data"];
+        res.add_member("data", x.get_string(), x.string_size());
+    }
+};
+
+void start_server(tcp::Server& ts, rpc::Server& rs, http::Server& hs,
+                  const fastring& body) {
+    if (FLG_m == "echo") {
+        ts.on_connection(on_echo_connection);
+        ts.start(FLG_ip.c_str(), FLG_port);
+    } else if (FLG_m == "rpc") {
+        rs.add_service(new EchoService);
+        rs.start(FLG_ip.c_str(), FLG_port);
+    } else {
+        hs.on_req([&body](const http::Req&, http::Res& res) {
+            res.set_status(200);
+            res.set_body(body.data(), body.size());
+        });
+        hs.start(FLG_ip.c_str(), FLG_port);
+    }
+}
+
+// ========================================================================
+// clients
+// ========================================================================
+struct Conf {
+    int64 end;      // when to stop sending, in microseconds
+    int64 next;     // when to send the first request
+    int64 interval; // between requests of a connection, 0 for closed-loop
+};
+
+// read a response, return size of the body, or -1 on error
+int read_response(tcp::Reader& r) {
+    if (FLG_m == "echo") return r.read_exact(FLG_size, 3000) > 0 ? FLG_size : -1;
+
+    int n = r.read_until("\r\n\r\n", 8192, 3000);
+    if (n <= 0) return -1;
+    fastring h(r.data(), r.size());
+    size_t p = h.find("Content-Length:");
+    if (p == h.npos) return -1;
+    const int len = atoi(h.data() + p + 15);
+    if (len > 0 && r.read_exact(len, 3000) != len) return -1;
+    return len;
+}
+
+void run_stream_client(Conf conf, Result* res, co::WaitGroup wg) {
+    tcp::Client cli(FLG_ip.c_str(), FLG_port);
+    fastring req;
+    if (FLG_m == "echo") {
+        req.append(FLG_size, 'x');
+    } else {
+        req << "GET /loadgen HTTP/1.1\r\nHost: " << FLG_ip << "\r\n\r\n";
+    }
+
+    if (!cli.connect(3000)) {
+        ++res->errors;
+        wg.done();
+        return;
+    }
+
+    tcp::Reader r(cli);
+    std::deque<int64> inflight; // when each request was scheduled
+    const size_t depth = FLG_d > 0 ? (size_t)FLG_d : 1;
+    int64 next = conf.next;
+    while (true) {
+        int64 now = now::us();
+        const bool sending = now < conf.end;
+        if (!sending && inflight.empty()) break;
+
+        // send requests that are due while the pipeline is not full
+        if (sending && inflight.size() < depth &&
+            (conf.interval == 0 || now >= next)) {
+            if (cli.send(req.data(), (int)req.size(), 3000) != (int)req.size()) {
+                ++res->errors;
+                break;
+            }
+            inflight.push_back(conf.interval == 0 ? now : next);
+            next += conf.interval;
+            continue;
+        }
+
+        if (inflight.empty()) {
+            co::sleep((uint32)((next - now + 999) / 1000));
+            continue;
+        }
+
+        // wait for a response, but no later than the next request is due
+        if (sending && conf.interval > 0 && inflight.size() < depth) {
+            int ms = (int)((next - now + 999) / 1000);
+            if (r.peek(1, ms > 0 ? ms : 1) < 0 && co::timeout()) continue;
+        }
+        const int n = read_response(r);
+        if (n < 0) {
+            ++res->errors;
+            break;
+        }
+        res->h.add(now::us() - inflight.front());
+        res->bytes += n;
+        inflight.pop_front();
+    }
+
+    res->errors += inflight.size();
+    wg.done();
+}
+
+void run_rpc_client(Conf conf, Result* res, co::WaitGroup wg) {
+    rpc::Client cli(FLG_ip.c_str(), FLG_port);
+    Json req;
+    req.add_member("service", "Echo");
+    req.add_member("data", fastring(FLG_size, 'x'));
+
+    int64 next = conf.next;
+    while (true) {
+        int64 now = now::us();
+        if (now >= conf.end) break;
+        if (conf.interval > 0 && now < next) {
+            co::sleep((uint32)((next - now + 999) / 1000));
+            continue;
+        }
+
+        const int64 t = conf.interval == 0 ? now : next;
+        next += conf.interval;
+        Json r;
+        cli.call(req, r);
+        Json::Value x = r["data"];
+        if (!x.is_string()) {
+            ++res->errors;
+            continue;
+        }
+        res->h.add(now::us() - t);
+        res->bytes += x.string_size();
+    }
+    wg.done();
+}
+
+void run_clients() {
+    const int n = FLG_c > 0 ? FLG_c : 1;
+    std::vector<std::unique_ptr<Result>> results;
+    for (int i = 0; i < n; ++i) results.emplace_back(new Result);
+
+    // in fixed-rate mode, connections send in turn with the same interval
+    const int64 start = now::us() + 10000;
+    const int64 interval = FLG_rate > 0 ? (int64)n * 1000000 / FLG_rate : 0;
+    co::WaitGroup wg;
+    wg.add(n);
+    for (int i = 0; i < n; ++i) {
+        Conf conf;
+        conf.end = start + (int64)FLG_sec * 1000000;
+        conf.next = start + (interval > 0 ? interval * i / n : 0);
+        conf.interval = interval;
+        Result* res = results[i].get();
+        go([conf, res, wg]() {
+            if (FLG_m == "rpc") {
+                run_rpc_client(conf, res, wg);
+            } else {
+                run_stream_client(conf, res, wg);
+            }
+        });
+    }
+    wg.wait();
+    const double sec = (now::us() - start) / 1e6;
+
+    Result all;
+    for (auto& x : results) {
+        all.h.merge(x->h);
+        all.errors += x->errors;
+        all.bytes += x->bytes;
+    }
+
+    const Histogram& h = all.h;
+    COUT << "mode: " << FLG_m << ", connections: " << n << ", depth: "
+         << (FLG_m == "rpc" ? 1 : FLG_d) << ", rate: "
+         << (FLG_rate > 0 ? str::from(FLG_rate) : fastring("closed-loop"))
+         << ", size: " << FLG_size << ", duration: " << sec << "s";
+    COUT << "requests: " << h.count() << ", errors: " << all.errors
+         << ", throughput: " << (uint64)(h.count() / sec) << " req/s, "
+         << (uint64)(all.bytes / sec / 1024) << " KB/s";
+    COUT << "latency(us): mean " << h.mean() << ", p50 " << h.percentile(50)
+         << ", p90 " << h.percentile(90) << ", p99 " << h.percentile(99)
+         << ", p99.9 " << h.percentile(99.9) << ", max " << h.max();
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+    if (FLG_m != "echo" && FLG_m != "rpc" && FLG_m != "http") {
+        COUT << "unknown protocol: " << FLG_m;
+        return 0;
+    }
+
+    tcp::Server ts;
+    rpc::Server rs;
+    http::Server hs;
+    fastring body(FLG_size, 'x');
+    if (FLG_r != "client") {
+        start_server(ts, rs, hs, body);
+        sleep::ms(32);
+    }
+
+    if (FLG_r != "server") {
+        run_clients();
+    } else {
+        while (true) sleep::sec(1024);
+    }
+
+    if (FLG_m == "echo") ts.exit();
+    if (FLG_m == "rpc") rs.exit();
+    if (FLG_m == "http") hs.exit();
+    co::exit();
+    return 0;
+}
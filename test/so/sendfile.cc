@@ -0,0 +1,121 @@
+#include "co/all.h"
+#include <fcntl.h>
+
+DEF_string(ip, "127.0.0.1", "ip");
+DEF_int32(port, 9990, "port");
+DEF_int32(mb, 256, "size of the file in MB");
+DEF_int32(n, 8, "number of transfers");
+DEF_string(m, "sendfile", "mode: copy, sendfile, proxy, splice");
+
+// Throughput benchmark for tcp::Connection::sendfile() and splice(). A server
+// on port+1 sends a file to each client, by a read() and send() loop in the
+// copy mode, or by sendfile() in other modes. In the proxy and splice modes,
+// clients connect to a proxy on port, which forwards data from the file
+// server by a recv() and send() loop, or by splice().
+const char* g_path = "sendfile.bench.tmp";
+
+bool copy_mode() { return FLG_m == "copy" || FLG_m == "proxy"; }
+
+void on_file_conn(tcp::Connection conn) {
+    const int64 n = (int64)FLG_mb << 20;
+    int fd = ::open(g_path, O_RDONLY);
+    if (fd == -1) {
+        ELOG << "open file failed: " << co::strerror();
+        conn.close();
+        return;
+    }
+
+    int64 r = 0;
+    if (FLG_m == "copy") {
+        fastream buf(64 * 1024);
+        while (r < n) {
+            ssize_t x = ::read(fd, (void*)buf.data(), buf.capacity());
+            if (x <= 0 || conn.send(buf.data(), (int)x) != (int)x) break;
+            r += x;
+        }
+    } else {
+        r = conn.sendfile(fd, 0, n);
+    }
+
+    if (r != n) ELOG << "send file failed: " << r;
+    ::close(fd);
+    conn.close();
+}
+
+void on_proxy_conn(tcp::Connection conn) {
+    tcp::Client up(FLG_ip.c_str(), FLG_port + 1);
+    if (!up.connect(3000)) {
+        conn.close();
+        return;
+    }
+
+    const int64 n = (int64)FLG_mb << 20;
+    int64 r = 0;
+    if (FLG_m == "proxy") {
+        fastream buf(64 * 1024);
+        while (r < n) {
+            int x = up.recv((void*)buf.data(), (int)buf.capacity());
+            if (x <= 0 || conn.send(buf.data(), x) != x) break;
+            r += x;
+        }
+    } else {
+        r = co::splice(up.socket(), conn.socket(), n);
+    }
+
+    if (r != n) ELOG << "proxy failed: " << r;
+    conn.close();
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+    if (FLG_m != "copy" && FLG_m != "sendfile" && FLG_m != "proxy" &&
+        FLG_m != "splice") {
+        COUT << "unknown mode: " << FLG_m;
+        return 0;
+    }
+
+    {
+        fs::file f(g_path, 'w');
+        fastring s(1 << 20, 'x');
+        for (int i = 0; i < FLG_mb; ++i) f.write(s.data(), s.size());
+    }
+
+    const bool proxy = FLG_m == "proxy" || FLG_m == "splice";
+    tcp::Server fserv, pserv;
+    fserv.on_connection(on_file_conn);
+    fserv.start(FLG_ip.c_str(), FLG_port + 1);
+    if (proxy) {
+        pserv.on_connection(on_proxy_conn);
+        pserv.start(FLG_ip.c_str(), FLG_port);
+    }
+    sleep::ms(32);
+
+    int64 total = 0;
+    co::WaitGroup wg;
+    wg.add(1);
+    Timer timer;
+    go([wg, &total, proxy]() {
+        fastream buf(256 * 1024);
+        for (int i = 0; i < FLG_n; ++i) {
+            tcp::Client cli(FLG_ip.c_str(), proxy ? FLG_port : FLG_port + 1);
+            if (!cli.connect(3000)) break;
+            int r;
+            while ((r = cli.recv((void*)buf.data(), (int)buf.capacity())) > 0) {
+                total += r;
+            }
+        }
+        wg.done();
+    });
+    wg.wait();
+    int64 us = timer.us();
+
+    COUT << "mode: " << FLG_m << ", received: " << (total >> 20) << " MB in "
+         << (us / 1000) << " ms, throughput: "
+         << (us > 0 ? total * 1000000 / us / (1 << 20) : 0) << " MB/s";
+
+    fs::remove(g_path);
+    if (proxy) pserv.exit();
+    fserv.exit();
+    co::exit();
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "co/all.h"
+#include <algorithm>
+#include <vector>
+
+DEF_string(ip, "127.0.0.1", "ip");
+DEF_int32(port, 9995, "port");
+DEF_string(key, "", "private key file");
+DEF_string(ca, "", "certificate file");
+DEF_int32(c, 8, "number of clients");
+DEF_int32(n, 500, "handshakes per client");
+DEF_bool(storm, false, "measure latency of an established connection too");
+
+DEC_bool(ssl_session_reuse);
+
+// Handshakes per second of ssl connections, with full handshakes, and then
+// with sessions resumed from the previous connection. Each connection sends
+// a byte and waits for the echo, so that session tickets are received:
+//   ssl_handshake -key key.pem -ca cert.pem
+// With -storm, an established connection sends a byte every millisecond
+// during the handshakes, and its latency is printed. Compare it with the
+// handshakes done in a thread pool:
+//   ssl_handshake -key key.pem -ca cert.pem -storm -ssl_handshake_threads 2
+void on_connection(tcp::Connection conn) {
+    char c;
+    while (conn.recvn(&c, 1, 3000) == 1) {
+        if (conn.send(&c, 1, 3000) != 1) break;
+    }
+    conn.close();
+}
+
+// latency in microseconds of requests on an established connection
+void ping(const bool* stop, std::vector<int64>* lat, co::WaitGroup wg) {
+    tcp::Client cli(FLG_ip.c_str(), FLG_port, true);
+    char c = 'x';
+    if (cli.connect(3000)) {
+        while (!atomic_get(stop)) {
+            Timer t;
+            if (cli.send(&c, 1, 3000) != 1 || cli.recvn(&c, 1, 3000) != 1) break;
+            lat->push_back(t.us());
+            co::sleep(1);
+        }
+    }
+    wg.done();
+}
+
+void run(bool reuse) {
+    FLG_ssl_session_reuse = reuse;
+    int64 errors = 0;
+    co::WaitGroup wg;
+    wg.add(FLG_c);
+
+    bool stop = false;
+    std::vector<int64> lat;
+    co::WaitGroup pwg;
+    pwg.add(1);
+    if (FLG_storm) {
+        go([&stop, &lat, pwg]() { ping(&stop, &lat, pwg); });
+    } else {
+        pwg.done();
+    }
+
+    Timer timer;
+    for (int i = 0; i < FLG_c; ++i) {
+        go([wg, &errors]() {
+            for (int k = 0; k < FLG_n; ++k) {
+                tcp::Client cli(FLG_ip.c_str(), FLG_port, true);
+                char c = 'x';
+                if (!cli.connect(3000, &c, 1) || cli.recvn(&c, 1, 3000) != 1) {
+                    atomic_inc(&errors);
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+    const int64 us = timer.us();
+    atomic_set(&stop, true);
+    pwg.wait();
+
+    const int64 total = (int64)FLG_c * FLG_n;
+    COUT << (reuse ? "resumed" : "full") << " handshakes: "
+         << (us > 0 ? total * 1000000 / us : 0) << "/s, errors: " << errors;
+    if (!lat.empty()) {
+        std::sort(lat.begin(), lat.end());
+        COUT << "  latency of the established connection(us): p50 "
+             << lat[lat.size() / 2] << ", p99 " << lat[lat.size() * 99 / 100]
+             << ", max " << lat.back();
+    }
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+    if (FLG_key.empty() || FLG_ca.empty()) {
+        COUT << "usage: ssl_handshake -key <key file> -ca <certificate file>";
+        return 0;
+    }
+
+    tcp::Server s;
+    s.on_connection(on_connection);
+    s.start(FLG_ip.c_str(), FLG_port, FLG_key.c_str(), FLG_ca.c_str());
+    sleep::ms(32);
+
+    run(false);
+    run(true);
+
+    s.exit();
+    co::exit();
+    return 0;
+}
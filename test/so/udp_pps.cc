@@ -0,0 +1,130 @@
+#include "co/all.h"
+
+DEF_string(ip, "127.0.0.1", "ip");
+DEF_int32(port, 9992, "port");
+DEF_int32(size, 64, "size of a datagram");
+DEF_int32(batch, 32, "datagrams per syscall, 1 for co::sendto and co::recvfrom");
+DEF_int32(sec, 3, "seconds to send");
+DEF_bool(gso, false, "send with UDP GSO, batch datagrams in one buffer");
+
+// Packets-per-second benchmark for co::sendmmsg() and co::recvmmsg(). A
+// sender sends datagrams to a receiver for -sec seconds, and both print the
+// packets per second. Compare -batch 1 with a larger batch, or try -gso:
+//   udp_pps -batch 1
+//   udp_pps -batch 32
+//   udp_pps -batch 32 -gso
+// Datagrams may be dropped by the kernel if the receiver is slower.
+int64 g_sent = 0;
+int64 g_recv = 0;
+bool g_stop = false;
+
+void receiver(co::WaitGroup ready, co::WaitGroup wg) {
+    sock_t fd = co::udp_socket();
+    struct sockaddr_in addr;
+    co::init_ip_addr(&addr, FLG_ip.c_str(), FLG_port);
+    co::set_recv_buffer_size(fd, 8 << 20);
+    CHECK_EQ(co::bind(fd, &addr, sizeof(addr)), 0) << co::strerror();
+
+    const int n = FLG_batch;
+    fastring buf((size_t)n * FLG_size, '\0');
+    std::vector<co::iovec> iov(n);
+    std::vector<co::mmsghdr> msgs(n);
+    for (int i = 0; i < n; ++i) {
+        iov[i].iov_base = (char*)buf.data() + (size_t)i * FLG_size;
+        iov[i].iov_len = FLG_size;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    ready.done();
+    // drain the socket after the sender has stopped
+    while (true) {
+        const bool stopped = atomic_get(&g_stop);
+        int r = n == 1 ? co::recvfrom(fd, (void*)buf.data(), FLG_size, 0, 0, 200)
+                       : co::recvmmsg(fd, msgs.data(), n, 200);
+        if (r == -1) {
+            if (co::timeout() && !stopped) continue;
+            break;
+        }
+        g_recv += n == 1 ? 1 : r;
+    }
+    co::close(fd);
+    wg.done();
+}
+
+void sender(co::WaitGroup wg) {
+    sock_t fd = co::udp_socket();
+    struct sockaddr_in addr;
+    co::init_ip_addr(&addr, FLG_ip.c_str(), FLG_port);
+    CHECK_EQ(co::connect(fd, &addr, sizeof(addr)), 0) << co::strerror();
+
+    int n = FLG_batch;
+    if (FLG_gso) {
+        if (co::set_udp_gso(fd, FLG_size) != 0) {
+            COUT << "set UDP_SEGMENT failed: " << co::strerror();
+            FLG_gso = false;
+        } else if (n * FLG_size > 65000) {
+            n = 65000 / FLG_size;
+        }
+    }
+
+    fastring buf((size_t)n * FLG_size, 'x');
+    std::vector<co::iovec> iov(n);
+    std::vector<co::mmsghdr> msgs(n);
+    for (int i = 0; i < n; ++i) {
+        iov[i].iov_base = (char*)buf.data() + (size_t)i * FLG_size;
+        iov[i].iov_len = FLG_size;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int64 end = now::ms() + FLG_sec * 1000;
+    while (now::ms() < end) {
+        int r;
+        if (FLG_gso) {
+            r = co::send(fd, buf.data(), (int)buf.size()) == -1 ? -1 : n;
+        } else if (n == 1) {
+            r = co::send(fd, buf.data(), FLG_size) == -1 ? -1 : 1;
+        } else {
+            r = co::sendmmsg(fd, msgs.data(), n);
+        }
+        if (r == -1) {
+            ELOG << "send failed: " << co::strerror();
+            break;
+        }
+        g_sent += r;
+        // UDP sends rarely block, let the receiver run if it is in the same
+        // scheduler
+        if (co::all_schedulers().size() == 1) co::sleep(0);
+    }
+
+    co::close(fd);
+    atomic_set(&g_stop, true);
+    wg.done();
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+    if (FLG_batch < 1) FLG_batch = 1;
+
+    // the receiver and the sender run in different schedulers if possible
+    auto& s = co::all_schedulers();
+    co::WaitGroup ready, wg;
+    ready.add(1);
+    wg.add(2);
+    s[0]->go([ready, wg]() { receiver(ready, wg); });
+    ready.wait();
+
+    Timer timer;
+    s[s.size() > 1 ? 1 : 0]->go([wg]() { sender(wg); });
+    wg.wait();
+    const int64 us = timer.us();
+
+    COUT << "size: " << FLG_size << ", batch: " << FLG_batch
+         << (FLG_gso ? ", gso" : "") << ", sent: " << (g_sent * 1000000 / us)
+         << " pps, received: " << (g_recv * 1000000 / us) << " pps";
+    co::exit();
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "co/all.h"
+
+DEF_int32(port, 9993, "port of the tcp server");
+DEF_string(path, "/tmp/co_uds_bench.sock", "path of the unix domain socket");
+DEF_int32(c, 8, "number of clients");
+DEF_int32(n, 20000, "requests per client");
+DEF_int32(size, 64, "size of a message");
+
+// Request-response benchmark of loopback TCP against unix domain sockets. An
+// echo server listens on both 127.0.0.1:port and unix:path, and -c clients
+// send -n messages of -size bytes to each of them in turn.
+void on_connection(tcp::Connection conn) {
+    fastring buf(FLG_size, '\0');
+    while (true) {
+        int r = conn.recvn((void*)buf.data(), FLG_size);
+        if (r <= 0 || conn.send(buf.data(), FLG_size) != FLG_size) break;
+    }
+    conn.close();
+}
+
+void run(const char* ip, int port) {
+    co::WaitGroup wg;
+    wg.add(FLG_c);
+    Timer timer;
+    for (int i = 0; i < FLG_c; ++i) {
+        go([ip, port, wg]() {
+            tcp::Client cli(ip, port);
+            fastring buf(FLG_size, 'x');
+            if (cli.connect(3000)) {
+                for (int k = 0; k < FLG_n; ++k) {
+                    if (cli.send(buf.data(), FLG_size) != FLG_size) break;
+                    if (cli.recvn((void*)buf.data(), FLG_size) != FLG_size) break;
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    const int64 us = timer.us();
+    const int64 total = (int64)FLG_c * FLG_n;
+    COUT << ip << ": " << (us > 0 ? total * 1000000 / us : 0) << " req/s, "
+         << "avg latency: " << (total > 0 ? us * FLG_c / total : 0) << " us";
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+    const fastring uds = "unix:" + FLG_path;
+
+    tcp::Server ts, us;
+    ts.on_connection(on_connection);
+    us.on_connection(on_connection);
+    ts.start("127.0.0.1", FLG_port);
+    us.start(uds.c_str(), 0);
+    sleep::ms(32);
+
+    run("127.0.0.1", FLG_port);
+    run(uds.c_str(), 0);
+
+    us.exit();
+    ts.exit();
+    co::exit();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "co/all.h"
+
+DEF_string(ip, "127.0.0.1", "ip");
+DEF_int32(port, 9991, "port");
+DEF_string(r, "both", "role: server, client or both");
+DEF_int32(mb, 256, "MB to be sent for each message size");
+
+// Find the message size from which co::send_zerocopy() beats co::send().
+// For each message size, the client asks the server to send -mb MB with
+// co::send() and then with co::send_zerocopy(), and prints the throughput.
+// The kernel copies data on the loopback interface anyway, run the server
+// and the client on different hosts for meaningful results:
+//   zerocopy -r server -ip 0.0.0.0
+//   zerocopy -r client -ip <server ip>
+struct Req {
+    uint32 size; // message size
+    uint32 zc;   // 1 for co::send_zerocopy()
+};
+
+void on_connection(tcp::Connection conn) {
+    Req req;
+    if (conn.recvn(&req, sizeof(req), 3000) != sizeof(req)) return;
+
+    const int64 total = (int64)FLG_mb << 20;
+    fastring buf(req.size, 'x');
+    for (int64 x = 0; x < total; x += req.size) {
+        const int n = (int)req.size;
+        int r = req.zc ? co::send_zerocopy(conn.socket(), buf.data(), n)
+                       : co::send(conn.socket(), buf.data(), n);
+        if (r != n) {
+            ELOG << "send failed: " << co::strerror();
+            break;
+        }
+    }
+    conn.close();
+}
+
+int64 run(uint32 size, uint32 zc) {
+    tcp::Client cli(FLG_ip.c_str(), FLG_port);
+    if (!cli.connect(3000)) return -1;
+
+    Req req = { size, zc };
+    Timer timer;
+    cli.send(&req, sizeof(req));
+    fastring buf(1 << 20, ' ');
+    int64 total = 0;
+    int r;
+    while ((r = cli.recv((void*)buf.data(), (int)buf.size())) > 0) total += r;
+    const int64 us = timer.us();
+    return us > 0 ? total * 1000000 / us / (1 << 20) : 0;
+}
+
+int main(int argc, char** argv) {
+    co::init(argc, argv);
+
+    tcp::Server s;
+    if (FLG_r != "client") {
+        s.on_connection(on_connection);
+        s.start(FLG_ip.c_str(), FLG_port);
+        sleep::ms(32);
+    }
+
+    if (FLG_r != "server") {
+        co::WaitGroup wg;
+        wg.add(1);
+        go([wg]() {
+            for (uint32 size = 4096; size <= (16u << 20); size <<= 2) {
+                const int64 a = run(size, 0);
+                const int64 b = run(size, 1);
+                COUT << "size: " << (size >> 10) << "K, send: " << a
+                     << " MB/s, send_zerocopy: " << b << " MB/s";
+            }
+            wg.done();
+        });
+        wg.wait();
+    } else {
+        while (true) sleep::sec(1024);
+    }
+
+    s.exit();
+    co::exit();
+    return 0;
+}
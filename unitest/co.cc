@@ -1,5 +1,8 @@
 #include "co/unitest.h"
 #include "co/co.h"
+#include "co/co/typed_pool.h"
+#include "co/co/task_group.h"
+#include "co/co/parallel.h"
 
 namespace test {
 
@@ -43,6 +46,24 @@ DEF_test(co) {
         wg.wait();
         EXPECT_EQ(v, 2);
         v = 0;
+
+        // one signal wakes up all waiting coroutines
+        co::Event e;
+        wg.add(64);
+        for (int i = 0; i < 64; ++i) {
+            go([wg, e, &v]() {
+                if (e.wait(3000)) atomic_inc(&v);
+                wg.done();
+            });
+        }
+        go([e]() {
+            co::sleep(10);
+            e.signal();
+        });
+
+        wg.wait();
+        EXPECT_EQ(v, 64);
+        v = 0;
     }
 
     DEF_case(channel) {
@@ -63,6 +84,37 @@ DEF_test(co) {
         wg.wait();
         EXPECT_EQ(v, 23);
         v = 0;
+
+        // ping-pong in the same scheduler, coroutines wake up each other by
+        // the local task queue, for more rounds than the scheduler runs it
+        // before checking IO events and timers
+        co::Chan<int> ping, pong;
+        auto s = co::next_scheduler();
+        int bad = 0;
+        wg.add(2);
+
+        s->go([wg, ping, pong, &bad]() {
+            int x = 0;
+            for (int i = 0; i < 1000; ++i) {
+                ping << i;
+                pong >> x;
+                if (x != i + 1) ++bad;
+                if (i % 100 == 99) co::sleep(1);
+            }
+            wg.done();
+        });
+
+        s->go([wg, ping, pong]() {
+            int x = 0;
+            for (int i = 0; i < 1000; ++i) {
+                ping >> x;
+                pong << x + 1;
+            }
+            wg.done();
+        });
+
+        wg.wait();
+        EXPECT_EQ(bad, 0);
     }
 
     DEF_case(mutex) {
@@ -81,6 +133,174 @@ DEF_test(co) {
         wg.wait();
         EXPECT_EQ(v, 8);
         v = 0;
+
+        // The lock is held longer than a waiter may starve, so the mutex turns
+        // into handoff mode. Waiters are in all schedulers, including the one
+        // of the owner, and each of them gets the lock in the end.
+        auto& scheds = co::all_schedulers();
+        const int n = (int)scheds.size() * 4;
+        wg.add(1);
+        scheds[0]->go([wg, m]() {
+            m.lock();
+            wg.done();
+            co::sleep(10);
+            m.unlock();
+        });
+        wg.wait();
+
+        wg.add(n);
+        for (int i = 0; i < n; ++i) {
+            scheds[i % scheds.size()]->go([wg, m, &v]() {
+                m.lock();
+                ++v;
+                co::sleep(1);
+                m.unlock();
+                wg.done();
+            });
+        }
+        wg.wait();
+        EXPECT_EQ(v, n);
+        v = 0;
+
+        bool unlocked = false;
+        wg.add(1);
+        go([wg, m, &unlocked]() {
+            unlocked = m.try_lock();
+            if (unlocked) m.unlock();
+            wg.done();
+        });
+        wg.wait();
+        EXPECT(unlocked);
+    }
+
+    DEF_case(rwmutex) {
+        co::RWMutex m;
+        co::WaitGroup wg;
+        int r = 0, bad = 0;
+        wg.add(16);
+
+        for (int i = 0; i < 16; ++i) {
+            go([wg, m, i, &v, &r, &bad]() {
+                for (int k = 0; k < 100; ++k) {
+                    if (i % 4 == 0) {
+                        co::WLockGuard g(m);
+                        if (atomic_get(&r) != 0) atomic_inc(&bad);
+                        ++v;
+                    } else {
+                        co::RLockGuard g(m);
+                        atomic_inc(&r);
+                        if (k % 16 == 0) co::sleep(1);
+                        atomic_dec(&r);
+                    }
+                }
+                wg.done();
+            });
+        }
+
+        wg.wait();
+        EXPECT_EQ(v, 400);
+        EXPECT_EQ(bad, 0);
+        v = 0;
+
+        EXPECT(m.try_rlock());
+        EXPECT(m.try_rlock());
+        EXPECT(!m.try_lock());
+        m.runlock();
+        m.runlock();
+        EXPECT(m.try_lock());
+        EXPECT(!m.try_rlock());
+        m.unlock();
+    }
+
+    DEF_case(semaphore) {
+        co::Semaphore sem(2);
+        co::WaitGroup wg;
+        int n = 0, max = 0;
+        wg.add(8);
+
+        for (int i = 0; i < 8; ++i) {
+            go([wg, sem, &n, &max]() {
+                sem.acquire();
+                int x = atomic_inc(&n);
+                if (x > atomic_get(&max)) atomic_swap(&max, x);
+                co::sleep(1);
+                atomic_dec(&n);
+                sem.release();
+                wg.done();
+            });
+        }
+
+        wg.wait();
+        EXPECT_LE(max, 2);
+        EXPECT(sem.try_acquire(2));
+        EXPECT(!sem.try_acquire());
+
+        bool r[4] = { 0 };
+        wg.add(1);
+        go([wg, sem, &r]() {
+            r[0] = sem.acquire(1);              // timeout
+            r[1] = sem.acquire_n(3, 1000);      // acquired after release(3)
+            r[2] = !sem.acquire_n(1, 0);        // not available
+            sem.release(3);
+            r[3] = sem.acquire_n(3, 0);
+            wg.done();
+        });
+        go([sem]() {
+            co::sleep(10);
+            sem.release(3);
+        });
+
+        wg.wait();
+        EXPECT(!r[0]);
+        EXPECT(r[1]);
+        EXPECT(r[2]);
+        EXPECT(r[3]);
+    }
+
+    DEF_case(cond_var) {
+        co::Mutex m;
+        co::CondVar cv;
+        co::WaitGroup wg;
+        int ready = 0;
+        wg.add(8);
+
+        for (int i = 0; i < 8; ++i) {
+            go([wg, m, cv, &ready, &v]() {
+                co::MutexGuard g(m);
+                while (ready == 0) cv.wait(m);
+                ++v;
+                wg.done();
+            });
+        }
+
+        go([m, cv, &ready]() {
+            co::sleep(1);
+            co::MutexGuard g(m);
+            ready = 1;
+            cv.notify_all();
+        });
+
+        wg.wait();
+        EXPECT_EQ(v, 8);
+        v = 0;
+
+        bool r[2] = { 0 };
+        wg.add(1);
+        go([wg, m, cv, &r]() {
+            co::MutexGuard g(m);
+            r[0] = cv.wait(m, 1);    // timeout
+            r[1] = cv.wait(m, 1000); // notified
+            wg.done();
+        });
+        go([m, cv]() {
+            co::sleep(20);
+            co::MutexGuard g(m);
+            cv.notify_one();
+        });
+
+        wg.wait();
+        EXPECT(!r[0]);
+        EXPECT(r[1]);
     }
 
     DEF_case(pool) {
@@ -122,6 +342,174 @@ DEF_test(co) {
         }
 
         p.clear();
+
+        // shared tier and idle eviction
+        int created = 0, destroyed = 0;
+        co::Pool q(
+            [&created]() { atomic_inc(&created); return (void*) new int(0); },
+            [&destroyed](void* p) { atomic_inc(&destroyed); delete (int*)p; },
+            1, 4, 20
+        );
+
+        size_t r[2] = { 0 };
+        wg.add(1);
+        go([wg, q, &r]() {
+            void* e[6];
+            for (int i = 0; i < 6; ++i) e[i] = q.pop();
+            for (int i = 0; i < 6; ++i) q.push(e[i]); // 1 local, 4 shared
+            r[0] = q.size();
+            for (int i = 0; i < 5; ++i) e[i] = q.pop();
+            for (int i = 0; i < 5; ++i) q.push(e[i]);
+            co::sleep(200);
+            r[1] = q.size();
+            wg.done();
+        });
+
+        wg.wait();
+        EXPECT_EQ(r[0], 1);
+        EXPECT_EQ(r[1], 0);
+        EXPECT_EQ(created, 6);
+        EXPECT_EQ(destroyed, 6);
+    }
+
+    DEF_case(future) {
+        co::Promise<int> p;
+        auto f = p.get_future();
+        EXPECT(!f.ready());
+        EXPECT(!f.wait(1));
+
+        co::WaitGroup wg;
+        wg.add(4);
+        for (int i = 0; i < 4; ++i) {
+            go([wg, f, &v]() {
+                if (f.get() == 7) atomic_inc(&v);
+                wg.done();
+            });
+        }
+        go([p]() {
+            co::sleep(1);
+            p.set_value(7);
+        });
+
+        wg.wait();
+        EXPECT_EQ(v, 4);
+        EXPECT(f.ready());
+        EXPECT_EQ(f.error(), 0);
+        EXPECT(!p.set_value(8));
+        EXPECT(!p.set_error(3));
+        v = 0;
+
+        co::Promise<int> q;
+        auto g = q.get_future();
+        go([q]() { q.set_error(5); });
+        EXPECT(g.wait(3000));
+        EXPECT_EQ(g.error(), 5);
+    }
+
+    DEF_case(task_group) {
+        co::TaskGroup<int> g;
+        for (int i = 0; i < 8; ++i) {
+            g.go([i](int& r) { r = i * i; return 0; });
+        }
+        EXPECT(g.wait_all());
+        EXPECT_EQ(g.error(), 0);
+        EXPECT_EQ(g.size(), 8);
+        for (int i = 0; i < 8; ++i) EXPECT_EQ(g.result(i), i * i);
+
+        // the first error cancels the siblings
+        co::TaskGroup<int> e;
+        e.go([](int&) { return 3; });
+        for (int i = 0; i < 4; ++i) {
+            e.go([e](int&) {
+                for (int k = 0; k < 100 && !e.cancelled(); ++k) co::sleep(10);
+                return e.cancelled() ? ECANCELED : 0;
+            });
+        }
+        EXPECT(e.wait_all(3000));
+        EXPECT_EQ(e.error(), 3);
+        EXPECT(e.cancelled());
+        for (int i = 1; i < 5; ++i) EXPECT_EQ(e.error(i), ECANCELED);
+
+        // wait_any returns the first task finished without error
+        co::TaskGroup<int> a;
+        a.go([](int&) { co::sleep(200); return 0; });
+        a.go([](int& r) { r = 1; return 0; });
+        EXPECT_EQ(a.wait_any(), 1);
+        EXPECT_EQ(a.result(1), 1);
+        a.cancel();
+        EXPECT(!a.wait_all(1));
+        EXPECT(a.wait_all());
+    }
+
+    DEF_case(parallel) {
+        std::vector<uint32> x(10000, 0);
+        co::parallel_for(0, x.size(), 64, [&x](size_t i) { x[i] += (uint32)i; });
+        int bad = 0;
+        for (size_t i = 0; i < x.size(); ++i) if (x[i] != i) ++bad;
+        EXPECT_EQ(bad, 0);
+
+        auto sum = [&x]() {
+            return co::parallel_reduce(0, x.size(), 0, (uint64)0,
+                [&x](size_t i) { return (uint64)x[i]; },
+                [](uint64 a, uint64 b) { return a + b; }
+            );
+        };
+        EXPECT_EQ(sum(), 9999ULL * 10000 / 2);
+
+        // called in a coroutine
+        uint64 r = 0;
+        co::WaitGroup wg;
+        wg.add(1);
+        go([wg, &r, &sum]() { r = sum(); wg.done(); });
+        wg.wait();
+        EXPECT_EQ(r, 9999ULL * 10000 / 2);
+
+        // empty and tiny ranges
+        EXPECT_EQ(co::parallel_reduce(5, 5, 0, 7, [](size_t) { return 1; },
+                  [](int a, int b) { return a + b; }), 7);
+        EXPECT_EQ(co::parallel_reduce(0, 3, 0, 0, [](size_t i) { return (int)i; },
+                  [](int a, int b) { return a + b; }), 3);
+
+        // accumulators of bool are written by workers concurrently
+        EXPECT(co::parallel_reduce(0, x.size(), 16, true,
+            [&x](size_t i) { return x[i] == i; },
+            [](bool a, bool b) { return a && b; }
+        ));
+        EXPECT(!co::parallel_reduce(0, x.size(), 16, true,
+            [&x](size_t i) { return x[i] != 7777; },
+            [](bool a, bool b) { return a && b; }
+        ));
+    }
+
+    DEF_case(typed_pool) {
+        co::TypedPool<int> p(2);
+        p.warm_up(2);
+
+        int n = co::scheduler_num();
+        co::WaitGroup wg;
+        wg.add(n);
+        for (auto& s : co::all_schedulers()) {
+            s->go([wg, &p]() {
+                int* x[3];
+                for (int i = 0; i < 3; ++i) x[i] = p.pop(); // 2 hits, 1 miss
+                for (int i = 0; i < 3; ++i) p.push(x[i]);   // 1 overflow
+                { co::TypedPoolGuard<int> g(p); *g = 7; }
+                wg.done();
+            });
+        }
+
+        wg.wait();
+        auto st = p.stats();
+        EXPECT_EQ(st.hit, 3 * n);
+        EXPECT_EQ(st.miss, n);
+        EXPECT_EQ(st.overflow, n);
+
+        p.clear();
+        wg.add(1);
+        size_t size = 1;
+        go([wg, &p, &size]() { size = p.size(); wg.done(); });
+        wg.wait();
+        EXPECT_EQ(size, 0);
     }
 }
 
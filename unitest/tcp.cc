@@ -0,0 +1,141 @@
+#include "co/unitest.h"
+#include "co/co.h"
+#include "co/so/tcp.h"
+
+namespace test {
+
+// Send the frames in pieces, so that the reader has to receive them in more
+// than one recv call.
+void send_frames(tcp::Connection conn) {
+    const char* s[] = {
+        "GET / HTTP/1.1\r\nHo", "st: x\r\n\r", "\nline1\nli", "ne2\r\n123",
+        "45abc", "def0123456789|",
+    };
+    for (size_t i = 0; i < sizeof(s) / sizeof(s[0]); ++i) {
+        if (conn.send(s[i], (int)strlen(s[i]), 1000) <= 0) break;
+        co::sleep(5);
+    }
+    conn.close();
+}
+
+// Echo a byte, and close the connection on 'q'.
+void echo_byte(tcp::Connection conn) {
+    char c;
+    while (conn.recvn(&c, 1) == 1) {
+        if (conn.send(&c, 1, 1000) != 1 || c == 'q') break;
+    }
+    conn.close();
+}
+
+DEF_test(tcp) {
+    DEF_case(reader) {
+        tcp::Server serv;
+        serv.on_connection(send_frames);
+        serv.start("127.0.0.1", 9960);
+
+        int r[8] = { 0 };
+        fastring v[4];
+        co::WaitGroup wg;
+        wg.add(1);
+        go([wg, &r, &v]() {
+            tcp::Client c("127.0.0.1", 9960);
+            if (c.connect(1000)) {
+                tcp::Reader rd(c, 16);
+                r[0] = rd.read_until("\r\n\r\n", 64, 1000);
+                v[0] = fastring(rd.data(), rd.size());
+                r[1] = rd.read_line(64, 1000);
+                v[1] = fastring(rd.data(), rd.size());
+                r[2] = rd.read_line(64, 1000);
+                v[2] = fastring(rd.data(), rd.size());
+                r[3] = rd.read_exact(5, 1000);
+                v[3] = fastring(rd.data(), rd.size());
+                char buf[8] = { 0 };
+                r[4] = rd.read_exact(buf, 3, 1000);
+                r[5] = (buf[0] == 'a' && buf[2] == 'c') ? 1 : 0;
+                r[6] = rd.read_until('|', 4, 1000); // too long
+                rd.release();
+            }
+            wg.done();
+        });
+        wg.wait();
+        serv.exit();
+
+        EXPECT_EQ(r[0], 27);
+        EXPECT_EQ(v[0], "GET / HTTP/1.1\r\nHost: x\r\n\r\n");
+        EXPECT_EQ(r[1], 6);
+        EXPECT_EQ(v[1], "line1");
+        EXPECT_EQ(r[2], 7);
+        EXPECT_EQ(v[2], "line2");
+        EXPECT_EQ(r[3], 5);
+        EXPECT_EQ(v[3], "12345");
+        EXPECT_EQ(r[4], 3);
+        EXPECT_EQ(r[5], 1);
+        EXPECT_EQ(r[6], -1);
+    }
+
+    DEF_case(conn_pool) {
+        tcp::Server serv;
+        serv.on_connection(echo_byte);
+        serv.start("127.0.0.1", 9961);
+
+        tcp::ConnPool pool(0, 8, 50);
+        tcp::ConnPool::Stats st[4];
+        bool same = false, ok = true;
+        co::WaitGroup wg;
+        wg.add(1);
+        go([wg, &pool, &st, &same, &ok]() {
+            auto echo = [&ok](tcp::Client* c, char x) {
+                char y = 0;
+                if (!c || c->send(&x, 1, 1000) != 1) {
+                    ok = false;
+                } else if (c->recvn(&y, 1, 1000) != 1 || y != x) {
+                    ok = false;
+                }
+            };
+
+            // the connection is reused
+            tcp::Client* a = pool.pop("127.0.0.1", 9961, 1000);
+            echo(a, 'x');
+            pool.push(a);
+            tcp::Client* b = pool.pop("127.0.0.1", 9961, 1000);
+            same = a == b;
+            echo(b, 'y');
+            st[0] = pool.stats();
+
+            // closed by the server while idle, dropped on the next pop
+            echo(b, 'q');
+            pool.push(b);
+            co::sleep(20);
+            tcp::Client* c = pool.pop("127.0.0.1", 9961, 1000);
+            echo(c, 'z');
+            pool.push(c);
+            st[1] = pool.stats();
+
+            // idle for longer than idle_ms, closed by the pool
+            co::sleep(200);
+            st[2] = pool.stats();
+            tcp::Client* d = pool.pop("127.0.0.1", 9961, 1000);
+            echo(d, 'w');
+            pool.push(d);
+            st[3] = pool.stats();
+            wg.done();
+        });
+        wg.wait();
+        serv.exit();
+
+        EXPECT(ok);
+        EXPECT(same);
+        EXPECT_EQ(st[0].miss, 1);
+        EXPECT_EQ(st[0].hit, 1);
+        EXPECT_EQ(st[0].busy, 1);
+        EXPECT_EQ(st[1].dead, 1);
+        EXPECT_EQ(st[1].miss, 2);
+        EXPECT_EQ(st[1].idle, 1);
+        EXPECT_EQ(st[2].evicted, 1);
+        EXPECT_EQ(st[2].idle, 0);
+        EXPECT_EQ(st[3].miss, 3);
+        EXPECT_EQ(st[3].busy, 0);
+    }
+}
+
+} // namespace test